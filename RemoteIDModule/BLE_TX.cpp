@@ -128,13 +128,13 @@ bool BLE_TX::init(void)
 
 #define IMIN(a,b) ((a)<(b)?(a):(b))
 
-bool BLE_TX::transmit_longrange(ODID_UAS_Data &UAS_data)
+bool BLE_TX::transmit_longrange(const ODIDCache &cache)
 {
     init();
-    // create a packed UAS data message
-    uint8_t payload[250];
-    int length = odid_message_build_pack(&UAS_data, payload, 255);
-    if (length <= 0) {
+    // the packed UAS data message
+    uint16_t length;
+    const uint8_t *payload = cache.get_pack(length);
+    if (length == 0) {
         return false;
     }
 
@@ -157,7 +157,7 @@ bool BLE_TX::transmit_longrange(ODID_UAS_Data &UAS_data)
     return true;
 }
 
-bool BLE_TX::transmit_legacy(ODID_UAS_Data &UAS_data)
+bool BLE_TX::transmit_legacy(ODID_UAS_Data &UAS_data, const ODIDCache &cache)
 {
     init();
     static uint8_t legacy_phase = 0;
@@ -172,111 +172,82 @@ bool BLE_TX::transmit_legacy(ODID_UAS_Data &UAS_data)
     switch (legacy_phase)
     {
     case  0: {
-        if (UAS_data.LocationValid) {
-            ODID_Location_encoded location_encoded;
-            memset(&location_encoded, 0, sizeof(location_encoded));
-            if (encodeLocationMessage(&location_encoded, &UAS_data.Location) != ODID_SUCCESS) {
-                break;
-            }
-
+        const ODID_Location_encoded *location_encoded = cache.get_location();
+        if (location_encoded != nullptr) {
             memcpy(&legacy_payload[sizeof(header)], &msg_counters[ODID_MSG_COUNTER_LOCATION], 1); //set packet counter
             msg_counters[ODID_MSG_COUNTER_LOCATION]++;
             //msg_counters[ODID_MSG_COUNTER_LOCATION] %= 256; //likely not be needed as it is defined as unint_8
 
-            memcpy(&legacy_payload[sizeof(header) + 1], &location_encoded, sizeof(location_encoded));
-            legacy_length = sizeof(header) + 1 + sizeof(location_encoded);
+            memcpy(&legacy_payload[sizeof(header) + 1], location_encoded, sizeof(*location_encoded));
+            legacy_length = sizeof(header) + 1 + sizeof(*location_encoded);
         }
         break;
     }
 
     case  1: {
-        if (UAS_data.BasicIDValid[0]) {
-            ODID_BasicID_encoded basicid_encoded;
-            memset(&basicid_encoded, 0, sizeof(basicid_encoded));
-            if (encodeBasicIDMessage(&basicid_encoded, &UAS_data.BasicID[0]) != ODID_SUCCESS) {
-                break;
-            }
-
+        const ODID_BasicID_encoded *basicid_encoded = cache.get_basic_id(0);
+        if (basicid_encoded != nullptr) {
             memcpy(&legacy_payload[sizeof(header)], &msg_counters[ODID_MSG_COUNTER_BASIC_ID], 1); //set packet counter
             msg_counters[ODID_MSG_COUNTER_BASIC_ID]++;
             //msg_counters[ODID_MSG_COUNTER_BASIC_ID] %= 256; //likely not be needed as it is defined as unint_8
 
-            memcpy(&legacy_payload[sizeof(header) + 1], &basicid_encoded, sizeof(basicid_encoded));
-            legacy_length = sizeof(header) + 1 + sizeof(basicid_encoded);
+            memcpy(&legacy_payload[sizeof(header) + 1], basicid_encoded, sizeof(*basicid_encoded));
+            legacy_length = sizeof(header) + 1 + sizeof(*basicid_encoded);
         }
         break;
     }
 
     case  2: {
-        if (UAS_data.SelfIDValid) {
-            ODID_SelfID_encoded selfid_encoded;
-            memset(&selfid_encoded, 0, sizeof(selfid_encoded));
-            if (encodeSelfIDMessage(&selfid_encoded, &UAS_data.SelfID) != ODID_SUCCESS) {
-                break;
-            }
-
+        const ODID_SelfID_encoded *selfid_encoded = cache.get_self_id();
+        if (selfid_encoded != nullptr) {
             memcpy(&legacy_payload[sizeof(header)], &msg_counters[ODID_MSG_COUNTER_SELF_ID], 1); //set packet counter
             msg_counters[ODID_MSG_COUNTER_SELF_ID]++;
             //msg_counters[ODID_MSG_COUNTER_SELF_ID] %= 256; //likely not be needed as it is defined as uint_8
 
-            memcpy(&legacy_payload[sizeof(header) + 1], &selfid_encoded, sizeof(selfid_encoded));
-            legacy_length = sizeof(header) + 1 + sizeof(selfid_encoded);
+            memcpy(&legacy_payload[sizeof(header) + 1], selfid_encoded, sizeof(*selfid_encoded));
+            legacy_length = sizeof(header) + 1 + sizeof(*selfid_encoded);
         }
         break;
     }
 
     case  3: {
-        if (UAS_data.SystemValid) {
-            ODID_System_encoded system_encoded;
-            memset(&system_encoded, 0, sizeof(system_encoded));
-            if (encodeSystemMessage(&system_encoded, &UAS_data.System) != ODID_SUCCESS) {
-                break;
-            }
-
+        const ODID_System_encoded *system_encoded = cache.get_system();
+        if (system_encoded != nullptr) {
             memcpy(&legacy_payload[sizeof(header)], &msg_counters[ODID_MSG_COUNTER_SYSTEM], 1); //set packet counter
             msg_counters[ODID_MSG_COUNTER_SYSTEM]++;
             //msg_counters[ODID_MSG_COUNTER_SYSTEM] %= 256; //likely not be needed as it is defined as uint_8
 
-            memcpy(&legacy_payload[sizeof(header) + 1], &system_encoded, sizeof(system_encoded));
-            legacy_length = sizeof(header) + 1 + sizeof(system_encoded);
+            memcpy(&legacy_payload[sizeof(header) + 1], system_encoded, sizeof(*system_encoded));
+            legacy_length = sizeof(header) + 1 + sizeof(*system_encoded);
         }
         break;
     }
 
     case  4: {
-        if (UAS_data.OperatorIDValid) {
-            ODID_OperatorID_encoded operatorid_encoded;
-            memset(&operatorid_encoded, 0, sizeof(operatorid_encoded));
-            if (encodeOperatorIDMessage(&operatorid_encoded, &UAS_data.OperatorID) != ODID_SUCCESS) {
-                break;
-            }
-
+        const ODID_OperatorID_encoded *operatorid_encoded = cache.get_operator_id();
+        if (operatorid_encoded != nullptr) {
             memcpy(&legacy_payload[sizeof(header)], &msg_counters[ODID_MSG_COUNTER_OPERATOR_ID], 1); //set packet counter
             msg_counters[ODID_MSG_COUNTER_OPERATOR_ID]++;
             //msg_counters[ODID_MSG_COUNTER_OPERATOR_ID] %= 256; //likely not be needed as it is defined as uint_8
 
-            memcpy(&legacy_payload[sizeof(header) + 1], &operatorid_encoded, sizeof(operatorid_encoded));
-            legacy_length = sizeof(header) + 1 + sizeof(operatorid_encoded);
+            memcpy(&legacy_payload[sizeof(header) + 1], operatorid_encoded, sizeof(*operatorid_encoded));
+            legacy_length = sizeof(header) + 1 + sizeof(*operatorid_encoded);
         }
         break;
     }
 
-    case  5: //in case of dual basic ID
-        if (UAS_data.BasicIDValid[1]) {
-            ODID_BasicID_encoded basicid2_encoded;
-            memset(&basicid2_encoded, 0, sizeof(basicid2_encoded));
-            if (encodeBasicIDMessage(&basicid2_encoded, &UAS_data.BasicID[1]) != ODID_SUCCESS) {
-                break;
-            }
-
+    case  5: { //in case of dual basic ID
+        const ODID_BasicID_encoded *basicid2_encoded = cache.get_basic_id(1);
+        if (basicid2_encoded != nullptr) {
             memcpy(&legacy_payload[sizeof(header)], &msg_counters[ODID_MSG_COUNTER_BASIC_ID], 1); //set packet counter
             msg_counters[ODID_MSG_COUNTER_BASIC_ID]++;
             //msg_counters[ODID_MSG_COUNTER_BASIC_ID] %= 256; //likely not be needed as it is defined as unint_8
 
-            memcpy(&legacy_payload[sizeof(header) + 1], &basicid2_encoded, sizeof(basicid2_encoded));
-            legacy_length = sizeof(header) + 1 + sizeof(basicid2_encoded);
+            memcpy(&legacy_payload[sizeof(header) + 1], basicid2_encoded, sizeof(*basicid2_encoded));
+            legacy_length = sizeof(header) + 1 + sizeof(*basicid2_encoded);
         }
         break;
+    }
 
     /*case  6: //set flight time
        // struct custom_data {  
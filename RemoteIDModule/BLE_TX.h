@@ -4,12 +4,13 @@
 #pragma once
 
 #include "transmitter.h"
+#include "odid_cache.h"
 
 class BLE_TX : public Transmitter {
 public:
     bool init(void) override;
-    bool transmit_longrange(ODID_UAS_Data &UAS_data);
-    bool transmit_legacy(ODID_UAS_Data &UAS_data);
+    bool transmit_longrange(const ODIDCache &cache);
+    bool transmit_legacy(ODID_UAS_Data &UAS_data, const ODIDCache &cache);
 
 private:
     bool initialised;
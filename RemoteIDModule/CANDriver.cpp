@@ -46,7 +46,7 @@ void CANDriver::init(uint32_t bitrate, uint32_t acceptance_code, uint32_t accept
 
 static const twai_general_config_t g_config =                      {.mode = TWAI_MODE_NORMAL, .tx_io = PIN_CAN_TX, .rx_io = PIN_CAN_RX, \
                                                                     .clkout_io = TWAI_IO_UNUSED, .bus_off_io = TWAI_IO_UNUSED,      \
-                                                                    .tx_queue_len = 5, .rx_queue_len = 64,                           \
+                                                                    .tx_queue_len = 16, .rx_queue_len = 64,                          \
                                                                     .alerts_enabled = TWAI_ALERT_NONE,  .clkout_divider = 0,        \
                                                                     .intr_flags = ESP_INTR_FLAG_LEVEL2
                                                                    };
@@ -230,6 +230,13 @@ bool CANDriver::send(const CANFrame &frame)
     message.data_length_code = frame.dlc;
     memcpy(message.data, frame.data, 8);
 
+    // never wait, the caller retries when the TX queue is full
+    if (twai_transmit(&message, 0) == ESP_OK) {
+        last_bus_recovery_ms = 0;
+        return true;
+    }
+
+    // only look at the bus state when sending fails
     twai_status_info_t info {};
     twai_get_status_info(&info);
     switch (info.state) {
@@ -248,33 +255,39 @@ bool CANDriver::send(const CANFrame &frame)
         break;
     }
     }
-
-    const esp_err_t sts = twai_transmit(&message, pdMS_TO_TICKS(5));
-    if (sts == ESP_OK) {
-        last_bus_recovery_ms = 0;
-    }
-
-    return (sts == ESP_OK);
+    return false;
 }
 
-bool CANDriver::receive(CANFrame &out_frame)
+/*
+  drain the RX queue the TWAI interrupt fills, without blocking
+ */
+uint16_t CANDriver::receive_batch(CANFrame *frames, uint16_t max_frames)
 {
+    uint16_t count = 0;
     twai_message_t message {};
-    esp_err_t recverr = twai_receive(&message, pdMS_TO_TICKS(5));
-    if (recverr != ESP_OK) {
-        return false;
+    while (count < max_frames && twai_receive(&message, 0) == ESP_OK) {
+        CANFrame &out_frame = frames[count];
+        memcpy(out_frame.data, message.data, 8);// copy new data
+        out_frame.dlc = message.data_length_code;
+        out_frame.id = message.identifier;
+        if (message.extd) {
+            out_frame.id |= CANARD_CAN_FRAME_EFF;
+        }
+        if (out_frame.id & CANFrame::FlagERR) { // same as a message.isErrorFrame() if done later.
+            continue;
+        }
+        count++;
     }
+    return count;
+}
 
-    memcpy(out_frame.data, message.data, 8);// copy new data
-    out_frame.dlc = message.data_length_code;
-    out_frame.id = message.identifier;
-    if (message.extd) {
-        out_frame.id |= CANARD_CAN_FRAME_EFF;
-    }
-    if (out_frame.id & CANFrame::FlagERR) { // same as a message.isErrorFrame() if done later.
-        return false;
+uint16_t CANDriver::rx_pending(void) const
+{
+    twai_status_info_t info {};
+    if (twai_get_status_info(&info) != ESP_OK) {
+        return 0;
     }
-    return true;
+    return info.msgs_to_rx;
 }
 
 #endif // AP_DRONECAN_ENABLED
@@ -7,7 +7,12 @@ public:
     void init(uint32_t bitrate, uint32_t acceptance_code, uint32_t acceptance_mask);
 
     bool send(const CANFrame &frame);
-    bool receive(CANFrame &out_frame);
+
+    // copy up to max_frames pending frames without waiting, returns how many
+    uint16_t receive_batch(CANFrame *frames, uint16_t max_frames);
+
+    // frames waiting in the driver RX queue
+    uint16_t rx_pending(void) const;
 
 private:
     struct Timings {
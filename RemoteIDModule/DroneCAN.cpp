@@ -83,6 +83,83 @@ void DroneCAN::init(void)
         canardSetLocalNodeID(&canard, g.can_node);
     }
     canard.user_reference = (void*)this;
+
+    init_rx_filter();
+
+    tx_latency[0].data_type_id = UAVCAN_PROTOCOL_NODESTATUS_ID;
+    tx_latency[1].data_type_id = DRONECAN_AURELIA_REMOTEID_STATUS_ID;
+    tx_latency[2].data_type_id = DRONECAN_AURELIA_UTIL_ACKMESSAGE_ID;
+}
+
+/*
+  build the data type filter from shouldAcceptTransfer(), so the
+  handlers stay the one list of what we take
+ */
+void DroneCAN::init_rx_filter(void)
+{
+    memset(rx_filter, 0, sizeof(rx_filter));
+    rx_type_count = 0;
+    for (uint32_t id=0; id<=0xFFFF; id++) {
+        uint64_t signature;
+        if (!shouldAcceptTransfer(&canard, &signature, id, CanardTransferTypeBroadcast, 0)) {
+            continue;
+        }
+        if (rx_type_count >= CAN_RX_MAX_TYPES) {
+            Serial.printf("DroneCAN: too many data types to filter\n");
+            rx_filter_enabled = false;
+            return;
+        }
+        rx_type_ids[rx_type_count++] = id;
+        rx_filter[(id % CAN_RX_FILTER_BITS) / 32] |= 1U << (id % 32);
+    }
+    rx_filter_enabled = true;
+}
+
+/*
+  see if a frame can be part of a transfer we take, before canard
+  does any reassembly. The bitmap rejects nearly everything else with
+  one lookup
+ */
+bool DroneCAN::rx_filter_accept(uint32_t can_id)
+{
+    if (!rx_filter_enabled) {
+        return true;
+    }
+    const uint8_t source_node_id = can_id & 0x7F;
+    uint16_t data_type_id;
+    if (can_id & 0x80) {
+        // service, only for us
+        const uint8_t dest_node_id = (can_id >> 8) & 0x7F;
+        const uint8_t local_node_id = canardGetLocalNodeID(&canard);
+        if (local_node_id == CANARD_BROADCAST_NODE_ID || dest_node_id != local_node_id) {
+            return false;
+        }
+        data_type_id = (can_id >> 16) & 0xFF;
+    } else if (source_node_id == CANARD_BROADCAST_NODE_ID) {
+        // anonymous messages only carry part of the ID, leave them to canard
+        return true;
+    } else {
+        data_type_id = (can_id >> 8) & 0xFFFF;
+    }
+
+    if (!(rx_filter[(data_type_id % CAN_RX_FILTER_BITS) / 32] & (1U << (data_type_id % 32)))) {
+        return false;
+    }
+    uint8_t lo = 0;
+    uint8_t hi = rx_type_count;
+    while (lo < hi) {
+        const uint8_t mid = (lo + hi) / 2;
+        if (rx_type_ids[mid] < data_type_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == rx_type_count || rx_type_ids[lo] != data_type_id) {
+        return false;
+    }
+    rx_type_counts[lo]++;
+    return true;
 }
 
 void DroneCAN::update(void)
@@ -117,13 +194,15 @@ void DroneCAN::ack_send(void)
 
     const uint16_t len = dronecan_aurelia_util_AckMessage_encode(&ack, buffer);
     static uint8_t tx_id;
-    canardBroadcast(&canard,
-                    DRONECAN_AURELIA_UTIL_ACKMESSAGE_SIGNATURE,
-                    DRONECAN_AURELIA_UTIL_ACKMESSAGE_ID,
-                    &tx_id,
-                    CANARD_TRANSFER_PRIORITY_LOW,
-                    (void*)buffer,
-                    len);
+    if (canardBroadcast(&canard,
+                        DRONECAN_AURELIA_UTIL_ACKMESSAGE_SIGNATURE,
+                        DRONECAN_AURELIA_UTIL_ACKMESSAGE_ID,
+                        &tx_id,
+                        CANARD_TRANSFER_PRIORITY_LOW,
+                        (void*)buffer,
+                        len) > 0) {
+        tx_queued(DRONECAN_AURELIA_UTIL_ACKMESSAGE_ID);
+    }
 }
 
 void DroneCAN::node_status_send(void)
@@ -134,13 +213,15 @@ void DroneCAN::node_status_send(void)
     const uint16_t len = uavcan_protocol_NodeStatus_encode(&node_status, buffer);
     static uint8_t tx_id;
 
-    canardBroadcast(&canard,
-                    UAVCAN_PROTOCOL_NODESTATUS_SIGNATURE,
-                    UAVCAN_PROTOCOL_NODESTATUS_ID,
-                    &tx_id,
-                    CANARD_TRANSFER_PRIORITY_LOW,
-                    (void*)buffer,
-                    len);
+    if (canardBroadcast(&canard,
+                        UAVCAN_PROTOCOL_NODESTATUS_SIGNATURE,
+                        UAVCAN_PROTOCOL_NODESTATUS_ID,
+                        &tx_id,
+                        CANARD_TRANSFER_PRIORITY_LOW,
+                        (void*)buffer,
+                        len) > 0) {
+        tx_queued(UAVCAN_PROTOCOL_NODESTATUS_ID);
+    }
 }
 
 void DroneCAN::arm_status_send(void)
@@ -158,13 +239,15 @@ void DroneCAN::arm_status_send(void)
     const uint16_t len = dronecan_aurelia_remoteid_Status_encode(&arm_status, buffer);
 
     static uint8_t tx_id;
-    canardBroadcast(&canard,
-                    DRONECAN_AURELIA_REMOTEID_STATUS_SIGNATURE,
-                    DRONECAN_AURELIA_REMOTEID_STATUS_ID,
-                    &tx_id,
-                    CANARD_TRANSFER_PRIORITY_LOW,
-                    (void*)buffer,
-                    len);
+    if (canardBroadcast(&canard,
+                        DRONECAN_AURELIA_REMOTEID_STATUS_SIGNATURE,
+                        DRONECAN_AURELIA_REMOTEID_STATUS_ID,
+                        &tx_id,
+                        CANARD_TRANSFER_PRIORITY_LOW,
+                        (void*)buffer,
+                        len) > 0) {
+        tx_queued(DRONECAN_AURELIA_REMOTEID_STATUS_ID);
+    }
 }
 
 void DroneCAN::onTransferReceived(CanardInstance* ins,
@@ -286,34 +369,104 @@ static bool shouldAcceptTransfer_trampoline(const CanardInstance* ins,
                                     source_node_id);
 }
 
+/*
+  move frames from the canard queue to the TWAI driver until it is
+  full, without waiting. What doesn't fit stays in the canard queue
+  and is retried after CAN_TX_RETRY_US
+ */
 void DroneCAN::processTx(void)
 {
+    const uint32_t now_us = micros();
+    if (tx_retry && int32_t(now_us - tx_retry_us) < 0) {
+        return;
+    }
+    tx_retry = false;
+
     for (const CanardCANFrame* txf = NULL; (txf = canardPeekTxQueue(&canard)) != NULL;) {
         CANFrame txmsg {};
         txmsg.dlc = CANFrame::dataLengthToDlc(txf->data_len);
         memcpy(txmsg.data, txf->data, txf->data_len);
         txmsg.id = (txf->id | CANFrame::FlagEFF);
 
-        // push message with 1s timeout
         if (can_driver.send(txmsg)) {
+            tx_sent(*txf, now_us);
             canardPopTxQueue(&canard);
-            tx_fail_count = 0;
+            tx_stats.frames++;
+            tx_fail_start_ms = 0;
         } else {
-            if (tx_fail_count < 8) {
-                tx_fail_count++;
-            } else {
+            const uint32_t now_ms = millis();
+            if (tx_fail_start_ms == 0) {
+                tx_fail_start_ms = now_ms;
+            } else if (now_ms - tx_fail_start_ms > CAN_TX_TIMEOUT_MS) {
+                // nobody is taking our frames, e.g. bus off
                 canardPopTxQueue(&canard);
+                tx_stats.dropped++;
+                tx_fail_start_ms = 0;
             }
+            tx_retry = true;
+            tx_retry_us = now_us + CAN_TX_RETRY_US;
             break;
         }
     }
 }
 
+void DroneCAN::tx_queued(uint16_t data_type_id)
+{
+    for (auto &l : tx_latency) {
+        if (l.data_type_id == data_type_id) {
+            // if the last one is still waiting keep timing that one
+            if (!l.queued) {
+                l.queued = true;
+                l.queued_us = micros();
+            }
+            return;
+        }
+    }
+}
+
+void DroneCAN::tx_sent(const CanardCANFrame &frame, uint32_t now_us)
+{
+    // only the last frame of a message transfer, the tail byte has the end bit
+    if ((frame.id & 0x80) || frame.data_len == 0 || !(frame.data[frame.data_len-1] & 0x40)) {
+        return;
+    }
+    const uint16_t data_type_id = (frame.id >> 8) & 0xFFFF;
+    for (auto &l : tx_latency) {
+        if (l.data_type_id != data_type_id || !l.queued) {
+            continue;
+        }
+        l.queued = false;
+        uint32_t latency_ms = (now_us - l.queued_us) / 1000;
+        uint8_t bin = 0;
+        while (latency_ms > 0 && bin < CAN_TX_LATENCY_BINS-1) {
+            latency_ms >>= 1;
+            bin++;
+        }
+        l.bins[bin]++;
+        return;
+    }
+}
+
+/*
+  process the received frames for up to CAN_RX_BUDGET_US, never
+  waiting for more. What is left over is done on the next call
+ */
 void DroneCAN::processRx(void)
 {
-    CANFrame rxmsg;
-    uint8_t count = 60;
-    while (count-- && can_driver.receive(rxmsg)) {
+    const uint32_t start_us = micros();
+    while (micros() - start_us < CAN_RX_BUDGET_US) {
+        if (rx_batch_next == rx_batch_count) {
+            rx_batch_next = 0;
+            rx_batch_count = can_driver.receive_batch(rx_batch, CAN_RX_BATCH);
+            if (rx_batch_count == 0) {
+                break;
+            }
+        }
+        const CANFrame &rxmsg = rx_batch[rx_batch_next++];
+        if (!rx_filter_accept(rxmsg.id & CANFrame::MaskExtID)) {
+            rx_stats.dropped++;
+            continue;
+        }
         CanardCANFrame rx_frame {};
         uint64_t timestamp = micros64();
         rx_frame.data_len = CANFrame::dlcToDataLength(rxmsg.dlc);
@@ -331,6 +484,16 @@ void DroneCAN::processRx(void)
 #else
         UNUSED(err);
 #endif
+        rx_stats.frames++;
+    }
+
+    rx_stats.backlog = (rx_batch_count - rx_batch_next) + can_driver.rx_pending();
+    if (rx_stats.backlog > rx_stats.backlog_max) {
+        rx_stats.backlog_max = rx_stats.backlog;
+    }
+    if (rx_stats.backlog > 0) {
+        // come straight back rather than after the next transport period
+        notify_rx();
     }
 }
 
@@ -558,6 +721,7 @@ void DroneCAN::handle_BasicID(CanardRxTransfer* transfer)
         COPY_FIELD(ua_type);
         COPY_STR(uas_id);
         last_basic_id_ms = millis();
+        mark_updated(MsgType::BASIC_ID);
     }
 }
 
@@ -571,6 +735,7 @@ void DroneCAN::handle_SelfID(CanardRxTransfer* transfer)
     COPY_STR(id_or_mac);
     COPY_FIELD(description_type);
     COPY_STR(description);
+    mark_updated(MsgType::SELF_ID);
 }
 
 void DroneCAN::handle_System(CanardRxTransfer* transfer)
@@ -599,6 +764,7 @@ void DroneCAN::handle_System(CanardRxTransfer* transfer)
     COPY_FIELD(class_eu);
     COPY_FIELD(operator_altitude_geo);
     COPY_FIELD(timestamp);
+    mark_updated(MsgType::SYSTEM);
 }
 
 void DroneCAN::handle_FltTime(CanardRxTransfer* transfer)
@@ -609,6 +775,7 @@ void DroneCAN::handle_FltTime(CanardRxTransfer* transfer)
     last_flt_time_ms = millis();
     memset(&mpkt, 0, sizeof(mpkt));
     COPY_FIELD(flt_time);
+    mark_updated(MsgType::FLT_TIME);
 }
 
 void DroneCAN::handle_SerialNumber(CanardRxTransfer* transfer)
@@ -619,6 +786,7 @@ void DroneCAN::handle_SerialNumber(CanardRxTransfer* transfer)
     last_serial_number_ms = millis();
     memset(&mpkt, 0, sizeof(mpkt));
     COPY_FIELD(serial_number);
+    mark_updated(MsgType::SERIAL_NUMBER);
 }
 
 void DroneCAN::handle_OperatorID(CanardRxTransfer* transfer)
@@ -632,6 +800,7 @@ void DroneCAN::handle_OperatorID(CanardRxTransfer* transfer)
     COPY_STR(id_or_mac);
     COPY_FIELD(operator_id_type);
     COPY_STR(operator_id);
+    mark_updated(MsgType::OPERATOR_ID);
 }
 
 void DroneCAN::handle_Location(CanardRxTransfer* transfer)
@@ -663,6 +832,7 @@ void DroneCAN::handle_Location(CanardRxTransfer* transfer)
     COPY_FIELD(speed_accuracy);
     COPY_FIELD(timestamp);
     COPY_FIELD(timestamp_accuracy);
+    mark_updated(MsgType::LOCATION);
 }
 
 /*
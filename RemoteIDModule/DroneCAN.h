@@ -16,6 +16,14 @@
 #include <dronecan.aurelia.util.AckMessage.h>
 
 #define CAN_POOL_SIZE 4096
+#define CAN_RX_BATCH 64 // same as the TWAI RX queue
+#define CAN_RX_BUDGET_US 2000 // longest processRx() runs before leaving the rest for next time
+#define CAN_RX_MAX_TYPES 16 // data types shouldAcceptTransfer() takes
+#define CAN_RX_FILTER_BITS 1024 // bitmap of the low bits of the accepted data type IDs
+#define CAN_TX_RETRY_US 1000 // wait after the TWAI TX queue was full
+#define CAN_TX_TIMEOUT_MS 1000 // drop a frame that could not be queued for this long
+#define CAN_TX_LATENCY_TYPES 3 // NodeStatus, arm Status and AckMessage
+#define CAN_TX_LATENCY_BINS 8 // under 1ms, then doubling up to 64ms and over
 
 class DroneCAN : public Transport {
 public:
@@ -23,6 +31,50 @@ public:
     void init(void) override;
     void update(void) override;
 
+    struct RxStats {
+        uint32_t frames;      // frames given to canard
+        uint32_t dropped;     // frames the data type filter dropped
+        uint16_t backlog;     // frames waiting after the last processRx()
+        uint16_t backlog_max;
+    };
+    void get_rx_stats(RxStats &stats) const
+    {
+        stats = rx_stats;
+    }
+
+    struct TxStats {
+        uint32_t frames;  // frames queued in the TWAI driver
+        uint32_t dropped; // frames given up on after CAN_TX_TIMEOUT_MS
+    };
+    void get_tx_stats(TxStats &stats) const
+    {
+        stats = tx_stats;
+    }
+
+    /*
+      time from canardBroadcast() to the last frame of the transfer
+      being queued in the TWAI driver
+     */
+    struct TxLatency {
+        uint16_t data_type_id;
+        bool queued;
+        uint32_t queued_us;
+        uint32_t bins[CAN_TX_LATENCY_BINS];
+    };
+    const TxLatency *get_tx_latency(uint8_t &count) const
+    {
+        count = CAN_TX_LATENCY_TYPES;
+        return tx_latency;
+    }
+
+    // frames received per accepted data type, returns the number of types
+    uint8_t get_rx_types(const uint16_t *&ids, const uint32_t *&counts) const
+    {
+        ids = rx_type_ids;
+        counts = rx_type_counts;
+        return rx_type_count;
+    }
+
 private:
     uint32_t last_node_status_ms;
     uint32_t last_ack_ms;
@@ -35,11 +87,38 @@ private:
     void arm_status_send(void);
     void ack_send(void);
 
-    uint8_t tx_fail_count;
+    // the frame at the head of the canard queue is retried at tx_retry_us
+    bool tx_retry;
+    uint32_t tx_retry_us;
+    uint32_t tx_fail_start_ms;
+    TxStats tx_stats;
+    TxLatency tx_latency[CAN_TX_LATENCY_TYPES];
+
+    void tx_queued(uint16_t data_type_id);
+    void tx_sent(const CanardCANFrame &frame, uint32_t now_us);
 
     void processTx(void);
     void processRx(void);
 
+    // frames taken from the driver but not yet processed
+    CANFrame rx_batch[CAN_RX_BATCH];
+    uint16_t rx_batch_count;
+    uint16_t rx_batch_next;
+    RxStats rx_stats;
+
+    /*
+      software acceptance filter on the data type ID, as the TWAI
+      filter can only split on priority
+     */
+    uint32_t rx_filter[CAN_RX_FILTER_BITS/32];
+    uint16_t rx_type_ids[CAN_RX_MAX_TYPES]; // ascending
+    uint32_t rx_type_counts[CAN_RX_MAX_TYPES];
+    uint8_t rx_type_count;
+    bool rx_filter_enabled;
+
+    void init_rx_filter(void);
+    bool rx_filter_accept(uint32_t can_id);
+
     uint64_t micros64();
     uint64_t base_micros64;
     uint32_t last_micros32;
@@ -16,9 +16,14 @@
 #include "DroneCAN.h"
 #include "WiFi_TX.h"
 #include "BLE_TX.h"
+#include "odid_cache.h"
+#include "uas_data.h"
+#include "scheduler.h"
+#include "broadcast.h"
 #include <esp_wifi.h>
 #include <WiFi.h>
 #include "parameters.h"
+#include "flt_log.h"
 #include "webinterface.h"
 #include "check_firmware.h"
 #include <esp_ota_ops.h>
@@ -43,7 +48,7 @@
 Adafruit_SSD1306 display(128, 64, &Wire, -1);
 
 #if AP_DRONECAN_ENABLED
-static DroneCAN dronecan;
+DroneCAN dronecan;
 #endif
 
 #if defined(BOARD_AURELIA_RID_S3) && AP_DRONECAN_ENABLED
@@ -57,6 +62,20 @@ static MAVLinkSerial mavlink2{Serial1, MAVLINK_COMM_1};
 
 static WiFi_TX wifi;
 static BLE_TX ble;
+static ODIDCache odid_cache;
+
+#define TRANSPORT_UPDATE_MS 5 // also run as soon as MAVLink data arrives
+#define LOOP_MAX_WAIT_MS 100
+
+// transport updates, loop() sleeps until the next one is due
+static Scheduler scheduler;
+static int8_t transport_slot;
+
+// WiFi and BLE send from their own tasks
+static Broadcaster broadcaster;
+
+static void update_transports(uint32_t now_ms);
+static void flush_params(uint32_t now_ms);
 
 #define DEBUG_BAUDRATE 57600
 
@@ -84,6 +103,9 @@ void setup()
     WRITE_PERI_REG(RTC_CNTL_BROWN_OUT_REG, 0);
 
     g.init();
+    const uint32_t flt_log_start_us = micros();
+    flt_log.init();
+    const uint32_t flt_log_us = micros() - flt_log_start_us;
 
     if (g.webserver_enable)
     {
@@ -93,6 +115,12 @@ void setup()
 
     // Serial for debug printf
     Serial.begin(g.baudrate);
+    Parameters::BootStats param_boot;
+    Parameters::get_boot_stats(param_boot);
+    Serial.printf("Boot: params %u us (load %u us from %s, %u NVS keys), fltlog %u us\n",
+                  unsigned(param_boot.init_us), unsigned(param_boot.load_us),
+                  param_boot.from_snapshot ? "snapshot" : "NVS", unsigned(param_boot.nvs_entries),
+                  unsigned(flt_log_us));
     led.test();
     led.set_state(Led::LedState::STARTING);
     led.update();
@@ -100,7 +128,7 @@ void setup()
     Serial1.begin(g.baudrate, SERIAL_8N1, PIN_UART_RX, PIN_UART_TX);
     display.begin(0x02, SCREEN_ADDRESS); // SSD1306_SWITCHCAPVCC
     display.setTextColor(1);
-    uint32_t flt_time_rid = g.find("FLT_TIME")->get_uint32();
+    uint32_t flt_time_rid = g.flt_time;
     print_i2c_display(flt_time_rid);
 
     // set all fields to invalid/initial values
@@ -148,10 +176,16 @@ flight_checks.init();
     esp_log_level_set("*", ESP_LOG_DEBUG);
 
     esp_ota_mark_app_valid_cancel_rollback();
-}
 
-#define IMIN(x, y) ((x) < (y) ? (x) : (y))
-#define ODID_COPY_STR(to, from) strncpy(to, (const char *)from, IMIN(sizeof(to), sizeof(from)))
+    // setup() runs on the loop() task, MAVLink data wakes it up
+    Transport::set_rx_task(xTaskGetCurrentTaskHandle());
+    const uint32_t now_ms = millis();
+    transport_slot = scheduler.add(update_transports, TRANSPORT_UPDATE_MS, now_ms);
+    scheduler.add(flush_params, PARAM_FLUSH_MS, now_ms);
+
+    broadcaster.init(wifi, ble);
+    Serial.printf("Boot: setup done at %u ms\n", unsigned(millis()));
+}
 
 void print_i2c_display(uint32_t flt_time)
 {
@@ -208,248 +242,90 @@ const char *check_flight_area()
 
 /*
   check parsing of UAS_data, this checks ranges of values to ensure we
-  will produce a valid pack
+  will produce a valid pack. The messages are encoded into the cache
+  the transmitters send from, only the parts in changed are encoded
+  again
   returns nullptr on no error, or a string error
  */
-static const char *check_parse(void)
+static const char *check_parse(uint8_t changed)
 {
-    String ret = "";
+    static uint8_t bad;
+    // if all errors would occur in this function, it will fit in
+    // 50 chars that is also the max for the arm status message
+    static char return_string[50];
+    const uint8_t last_bad = bad;
 
-    {
-        ODID_Location_encoded encoded{};
-        if (encodeLocationMessage(&encoded, &UAS_data.Location) != ODID_SUCCESS)
-        {
-            ret += "LOC ";
-        }
-        else
-        {
+    bad = odid_cache.update(UAS_data, changed);
 #if AP_DRONECAN_ENABLED && defined(BOARD_AURELIA_RID_S3)
-            flight_checks.update_location(UAS_data.Location.Latitude, UAS_data.Location.Longitude);
+    if ((changed & UAS_PART_LOCATION) && !(bad & ODID_BAD_LOCATION))
+    {
+        flight_checks.update_location(UAS_data.Location.Latitude, UAS_data.Location.Longitude);
+    }
 #endif
-        }
+    if (bad == 0)
+    {
+        return nullptr;
     }
+    if (bad != last_bad)
     {
-        ODID_System_encoded encoded{};
-        if (encodeSystemMessage(&encoded, &UAS_data.System) != ODID_SUCCESS)
+        String ret = "";
+        if (bad & ODID_BAD_LOCATION)
+        {
+            ret += "LOC ";
+        }
+        if (bad & ODID_BAD_SYSTEM)
         {
             ret += "SYS ";
         }
-    }
-    {
-        ODID_BasicID_encoded encoded{};
-        if (UAS_data.BasicIDValid[0] == 1)
+        if (bad & ODID_BAD_BASIC_ID_1)
         {
-            if (encodeBasicIDMessage(&encoded, &UAS_data.BasicID[0]) != ODID_SUCCESS)
-            {
-                ret += "ID_1 ";
-            }
+            ret += "ID_1 ";
         }
-        memset(&encoded, 0, sizeof(encoded));
-        if (UAS_data.BasicIDValid[1] == 1)
+        if (bad & ODID_BAD_BASIC_ID_2)
         {
-            if (encodeBasicIDMessage(&encoded, &UAS_data.BasicID[1]) != ODID_SUCCESS)
-            {
-                ret += "ID_2 ";
-            }
+            ret += "ID_2 ";
         }
-    }
-    {
-        ODID_SelfID_encoded encoded{};
-        if (encodeSelfIDMessage(&encoded, &UAS_data.SelfID) != ODID_SUCCESS)
+        if (bad & ODID_BAD_SELF_ID)
         {
             ret += "SELF_ID ";
         }
-    }
-    {
-        ODID_OperatorID_encoded encoded{};
-        if (encodeOperatorIDMessage(&encoded, &UAS_data.OperatorID) != ODID_SUCCESS)
+        if (bad & ODID_BAD_OPERATOR_ID)
         {
             ret += "OP_ID ";
         }
-    }
-    if (ret.length() > 0)
-    {
-        // if all errors would occur in this function, it will fit in
-        // 50 chars that is also the max for the arm status message
-        static char return_string[50];
         memset(return_string, 0, sizeof(return_string));
         snprintf(return_string, sizeof(return_string) - 1, "bad %s data", ret.c_str());
-        return return_string;
     }
-    return nullptr;
+    return return_string;
 }
 
 /*
-  fill in UAS_data from MAVLink packets
+  fill in UAS_data from MAVLink packets, only the parts whose messages
+  (or parameters) changed since the last call are rebuilt
  */
 static void set_data(Transport &t)
 {
-    const auto &operator_id = t.get_operator_id();
-    const auto &basic_id = t.get_basic_id();
-    const auto &system = t.get_system();
-    const auto &self_id = t.get_self_id();
-    const auto &location = t.get_location();
     const auto &flt_time = t.get_flt_time();
-    const auto &serial_number = t.get_serial_number();
-
-    odid_initUasData(&UAS_data);
-
-    /*
-      if we don't have BasicID info from parameters and we have it
-      from the DroneCAN or MAVLink transport then copy it to the
-      parameters to persist it. This makes it possible to set the
-      UAS_ID string via a MAVLink BASIC_ID message and also offers a
-      migration path from the old approach of GCS setting these values
-      to having them as parameters
-
-      BasicID 2 can be set in parameters, or provided via mavlink We
-      don't persist the BasicID2 if provided via mavlink to allow
-      users to change BasicID2 on different days
-     */
-    if (!g.have_basic_id_info() && !(g.options & OPTIONS_DONT_SAVE_BASIC_ID_TO_PARAMETERS))
-    {
-        if (basic_id.ua_type != 0 &&
-            basic_id.id_type != 0 &&
-            strnlen((const char *)basic_id.uas_id, 20) > 0)
-        {
-            g.set_by_name_uint8("UAS_TYPE", basic_id.ua_type);
-            g.set_by_name_uint8("UAS_ID_TYPE", basic_id.id_type);
-            char uas_id[21]{};
-            ODID_COPY_STR(uas_id, basic_id.uas_id);
-            g.set_by_name_string("UAS_ID", uas_id);
-        }
-    }
+    bool flt_time_changed;
+    const uint8_t changed = uas_data_update(t, UAS_data, flt_time_changed);
 
-    // BasicID
-    if (g.have_basic_id_info() && !(g.options & OPTIONS_DONT_SAVE_BASIC_ID_TO_PARAMETERS))
+    if (flt_time_changed)
     {
-        // from parameters
-        UAS_data.BasicID[0].UAType = (ODID_uatype_t)g.ua_type;
-        UAS_data.BasicID[0].IDType = (ODID_idtype_t)g.id_type;
-        ODID_COPY_STR(UAS_data.BasicID[0].UASID, g.uas_id);
-        UAS_data.BasicIDValid[0] = 1;
-
-        // BasicID 2
-        if (g.have_basic_id_2_info())
-        {
-            // from parameters
-            UAS_data.BasicID[1].UAType = (ODID_uatype_t)g.ua_type_2;
-            UAS_data.BasicID[1].IDType = (ODID_idtype_t)g.id_type_2;
-            ODID_COPY_STR(UAS_data.BasicID[1].UASID, g.uas_id_2);
-            UAS_data.BasicIDValid[1] = 1;
-        }
-        else if (strcmp((const char *)g.uas_id, (const char *)basic_id.uas_id) != 0)
+        uint32_t flt_time_aux = g.flt_time_aux;
+        if (flt_time.flt_time > 0 && flt_time_aux != flt_time.flt_time)
         {
-            /*
-              no BasicID 2 in the parameters, if one is provided on MAVLink
-              and it is a different uas_id from the basicID1 then use it as BasicID2
-            */
-            if (basic_id.ua_type != 0 &&
-                basic_id.id_type != 0 &&
-                strnlen((const char *)basic_id.uas_id, 20) > 0)
-            {
-                UAS_data.BasicID[1].UAType = (ODID_uatype_t)basic_id.ua_type;
-                UAS_data.BasicID[1].IDType = (ODID_idtype_t)basic_id.id_type;
-                ODID_COPY_STR(UAS_data.BasicID[1].UASID, basic_id.uas_id);
-                UAS_data.BasicIDValid[1] = 1;
-            }
-        }
-    }
+            uint32_t flt_time_rid = g.flt_time;
+            uint32_t new_time = flt_time.flt_time > flt_time_rid ? flt_time.flt_time : (abs((int32_t)(flt_time.flt_time - flt_time_aux)) + flt_time_rid);
+            bool flt_time_flag = flt_time.flt_time >= flt_time_aux;
+            flt_log.update(flt_time_flag ? new_time : flt_time_rid, flt_time.flt_time);
 
-    if (g.options & OPTIONS_DONT_SAVE_BASIC_ID_TO_PARAMETERS)
-    {
-        if (basic_id.ua_type != 0 &&
-            basic_id.id_type != 0 &&
-            strnlen((const char *)basic_id.uas_id, 20) > 0)
-        {
-            if (strcmp((const char *)UAS_data.BasicID[0].UASID, (const char *)basic_id.uas_id) != 0 && strnlen((const char *)basic_id.uas_id, 20) > 0)
-            {
-                UAS_data.BasicID[1].UAType = (ODID_uatype_t)basic_id.ua_type;
-                UAS_data.BasicID[1].IDType = (ODID_idtype_t)basic_id.id_type;
-                ODID_COPY_STR(UAS_data.BasicID[1].UASID, basic_id.uas_id);
-                UAS_data.BasicIDValid[1] = 1;
-            }
-            else
+            if (flt_time_flag)
             {
-                UAS_data.BasicID[0].UAType = (ODID_uatype_t)basic_id.ua_type;
-                UAS_data.BasicID[0].IDType = (ODID_idtype_t)basic_id.id_type;
-                ODID_COPY_STR(UAS_data.BasicID[0].UASID, basic_id.uas_id);
-                UAS_data.BasicIDValid[0] = 1;
+                print_i2c_display(new_time);
             }
         }
     }
-
-    // OperatorID
-    if (strlen(operator_id.operator_id) > 0)
-    {
-        UAS_data.OperatorID.OperatorIdType = (ODID_operatorIdType_t)operator_id.operator_id_type;
-        ODID_COPY_STR(UAS_data.OperatorID.OperatorId, operator_id.operator_id);
-        UAS_data.OperatorIDValid = 1;
-    }
-
-    // SelfID
-    if (strlen(self_id.description) > 0)
-    {
-        UAS_data.SelfID.DescType = (ODID_desctype_t)self_id.description_type;
-        ODID_COPY_STR(UAS_data.SelfID.Desc, self_id.description);
-        UAS_data.SelfIDValid = 1;
-    }
-
-    // System
-    if (system.timestamp != 0)
-    {
-        UAS_data.System.OperatorLocationType = (ODID_operator_location_type_t)system.operator_location_type;
-        UAS_data.System.ClassificationType = (ODID_classification_type_t)system.classification_type;
-        UAS_data.System.OperatorLatitude = system.operator_latitude * 1.0e-7;
-        UAS_data.System.OperatorLongitude = system.operator_longitude * 1.0e-7;
-        UAS_data.System.AreaCount = system.area_count;
-        UAS_data.System.AreaRadius = system.area_radius;
-        UAS_data.System.AreaCeiling = system.area_ceiling;
-        UAS_data.System.AreaFloor = system.area_floor;
-        UAS_data.System.CategoryEU = (ODID_category_EU_t)system.category_eu;
-        UAS_data.System.ClassEU = (ODID_class_EU_t)system.class_eu;
-        UAS_data.System.OperatorAltitudeGeo = system.operator_altitude_geo;
-        UAS_data.System.Timestamp = system.timestamp;
-        UAS_data.SystemValid = 1;
-    }
-
-    // Location
-    if (location.timestamp != 0)
-    {
-        UAS_data.Location.Status = (ODID_status_t)location.status;
-        UAS_data.Location.Direction = location.direction * 0.01;
-        UAS_data.Location.SpeedHorizontal = location.speed_horizontal * 0.01;
-        UAS_data.Location.SpeedVertical = location.speed_vertical * 0.01;
-        UAS_data.Location.Latitude = location.latitude * 1.0e-7;
-        UAS_data.Location.Longitude = location.longitude * 1.0e-7;
-        UAS_data.Location.AltitudeBaro = location.altitude_barometric;
-        UAS_data.Location.AltitudeGeo = location.altitude_geodetic;
-        UAS_data.Location.HeightType = (ODID_Height_reference_t)location.height_reference;
-        UAS_data.Location.Height = location.height;
-        UAS_data.Location.HorizAccuracy = (ODID_Horizontal_accuracy_t)location.horizontal_accuracy;
-        UAS_data.Location.VertAccuracy = (ODID_Vertical_accuracy_t)location.vertical_accuracy;
-        UAS_data.Location.BaroAccuracy = (ODID_Vertical_accuracy_t)location.barometer_accuracy;
-        UAS_data.Location.SpeedAccuracy = (ODID_Speed_accuracy_t)location.speed_accuracy;
-        UAS_data.Location.TSAccuracy = (ODID_Timestamp_accuracy_t)location.timestamp_accuracy;
-        UAS_data.Location.TimeStamp = location.timestamp;
-        UAS_data.LocationValid = 1;
-    }
-
-    uint32_t flt_time_aux = g.find("FLT_TIME_AUX")->get_uint32();
-    if (flt_time.flt_time > 0 && flt_time_aux != flt_time.flt_time)
-    {
-        uint32_t flt_time_rid = g.find("FLT_TIME")->get_uint32();
-        uint32_t new_time = flt_time.flt_time > flt_time_rid ? flt_time.flt_time : (abs((int32_t)(flt_time.flt_time - flt_time_aux)) + flt_time_rid);
-        bool flt_time_flag = flt_time.flt_time >= flt_time_aux;
-        g.set_by_name_uint32("FLT_TIME_AUX", flt_time.flt_time);
-
-        if (flt_time_flag)
-        {
-            print_i2c_display(new_time);
-            g.set_by_name_uint32("FLT_TIME", new_time);
-        }
-    }
-    const char *reason = check_parse();
+    const char *reason = check_parse(changed);
 #if defined(BOARD_AURELIA_RID_S3)
     const char *flt_check = check_flight_area();
     const char *res = flt_check==nullptr?reason:flt_check;
@@ -497,7 +373,11 @@ void send_ack_response(Transport &t)
 
 static uint8_t loop_counter = 0;
 
-void loop()
+/*
+  transports, then UAS_data for the radio tasks. Runs every
+  TRANSPORT_UPDATE_MS and as soon as MAVLink data arrives
+ */
+static void update_transports(uint32_t now_ms)
 {
 #if AP_MAVLINK_ENABLED
     mavlink1.update();
@@ -507,7 +387,7 @@ void loop()
     dronecan.update();
 #endif
 
-    const uint32_t now_ms = millis();
+    now_ms = millis();
 
     // the transports have common static data, so we can just use the
     // first for status
@@ -519,7 +399,6 @@ void loop()
 #error "Must enable DroneCAN or MAVLink"
 #endif
 
-    bool have_location = false;
     const uint32_t last_location_ms = transport.get_last_location_ms();
     const uint32_t last_system_ms = transport.get_last_system_ms();
 
@@ -566,7 +445,6 @@ void loop()
         // only broadcast if we have received a location at least once
         if (last_location_ms == 0)
         {
-            delay(1);
             return;
         }
     }
@@ -577,39 +455,21 @@ void loop()
     }
 
     set_data(transport);
+    broadcaster.publish(UAS_data, odid_cache);
+}
 
-    static uint32_t last_update_wifi_nan_ms;
-    if (g.wifi_nan_rate > 0 &&
-        now_ms - last_update_wifi_nan_ms > 1000 / g.wifi_nan_rate)
-    {
-        last_update_wifi_nan_ms = now_ms;
-        wifi.transmit_nan(UAS_data);
-    }
-
-    static uint32_t last_update_wifi_beacon_ms;
-    if (g.wifi_beacon_rate > 0 &&
-        now_ms - last_update_wifi_beacon_ms > 1000 / g.wifi_beacon_rate)
-    {
-        last_update_wifi_beacon_ms = now_ms;
-        wifi.transmit_beacon(UAS_data);
-    }
+static void flush_params(uint32_t now_ms)
+{
+    g.flush();
+}
 
-    static uint32_t last_update_bt5_ms;
-    if (g.bt5_rate > 0 &&
-        now_ms - last_update_bt5_ms > 1000 / g.bt5_rate)
-    {
-        last_update_bt5_ms = now_ms;
-        ble.transmit_longrange(UAS_data);
-    }
+void loop()
+{
+    const uint32_t wait_ms = scheduler.run(millis(), LOOP_MAX_WAIT_MS);
 
-    static uint32_t last_update_bt4_ms;
-    int bt4_states = UAS_data.BasicIDValid[1] ? 7 : 6;
-    if (g.bt4_rate > 0 &&
-        now_ms - last_update_bt4_ms > (1000.0f / bt4_states) / g.bt4_rate)
+    // sleep until the next slot is due, or until a transport has data
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms)) > 0)
     {
-        last_update_bt4_ms = now_ms;
-        ble.transmit_legacy(UAS_data);
+        scheduler.trigger(transport_slot, millis());
     }
-    // sleep for a bit for power saving
-    delay(1);
 }
@@ -5,6 +5,7 @@
  */
 
 #include "WiFi_TX.h"
+#include <odid_wifi.h>
 #include <esp_wifi.h>
 #include <WiFi.h>
 #include <esp_system.h>
@@ -44,78 +45,147 @@ bool WiFi_TX::init(void)
     return true;
 }
 
-bool WiFi_TX::transmit_nan(ODID_UAS_Data &UAS_data)
+/*
+  NAN action frame around the cached message pack, same layout as
+  odid_wifi_build_message_pack_nan_action_frame()
+ */
+int WiFi_TX::build_nan_action_frame(const uint8_t *pack, uint16_t pack_length)
+{
+    // NAN cluster broadcast address and the "org.opendroneid.remoteid" service hash
+    const uint8_t target_addr[6] { 0x51, 0x6F, 0x9A, 0x01, 0x00, 0x00 };
+    const uint8_t wifi_alliance_oui[3] { 0x50, 0x6F, 0x9A };
+    const uint8_t service_id[6] { 0x88, 0x69, 0x19, 0x9D, 0x92, 0x09 };
+
+    const size_t length = sizeof(ieee80211_mgmt) + sizeof(nan_service_discovery) +
+        sizeof(nan_service_descriptor_attribute) + sizeof(ODID_service_info) + pack_length +
+        sizeof(nan_service_descriptor_extension_attribute);
+    if (length > sizeof(nan_frame)) {
+        return -1;
+    }
+    memset(nan_frame, 0, length);
+    uint8_t *p = nan_frame;
+
+    auto *mgmt = (ieee80211_mgmt *)p;
+    mgmt->frame_control = IEEE80211_FTYPE_MGMT | IEEE80211_STYPE_ACTION;
+    memcpy(mgmt->da, target_addr, sizeof(mgmt->da));
+    memcpy(mgmt->sa, WiFi_mac_addr, sizeof(mgmt->sa));
+    memcpy(mgmt->bssid, target_addr, sizeof(mgmt->bssid));
+    p += sizeof(*mgmt);
+
+    auto *nsd = (nan_service_discovery *)p;
+    nsd->category = 0x04;    // public action frame
+    nsd->action_code = 0x09; // vendor specific
+    memcpy(nsd->oui, wifi_alliance_oui, sizeof(nsd->oui));
+    nsd->oui_type = 0x13;    // NAN
+    p += sizeof(*nsd);
+
+    auto *nsda = (nan_service_descriptor_attribute *)p;
+    nsda->header.attribute_id = 0x03; // service descriptor
+    memcpy(nsda->service_id, service_id, sizeof(nsda->service_id));
+    nsda->instance_id = 0x01;
+    nsda->requestor_instance_id = 0x00; // broadcast
+    nsda->service_control = 0x10;       // follow up
+    nsda->service_info_length = sizeof(ODID_service_info) + pack_length;
+    nsda->header.length = sizeof(*nsda) - sizeof(nan_attribute_header) + nsda->service_info_length;
+    p += sizeof(*nsda);
+
+    // the message counter is set on each send
+    p += sizeof(ODID_service_info);
+    memcpy(p, pack, pack_length);
+    p += pack_length;
+
+    auto *nsdea = (nan_service_descriptor_extension_attribute *)p;
+    nsdea->header.attribute_id = 0x0E; // service descriptor extension
+    nsdea->header.length = 0x0004;
+    nsdea->instance_id = 0x01;
+    nsdea->control = 0x0200;
+
+    return length;
+}
+
+bool WiFi_TX::transmit_nan(const ODIDCache &cache)
 {
     init();
 
-    uint8_t buffer[1024] {};
+    memset(nan_sync_frame, 0, sizeof(nan_sync_frame));
 
     int length;
     if ((length = odid_wifi_build_nan_sync_beacon_frame((char *)WiFi_mac_addr,
-                  buffer,sizeof(buffer))) > 0) {
-        if (esp_wifi_80211_tx(WIFI_IF_AP,buffer,length,true) != ESP_OK) {
+                  nan_sync_frame,sizeof(nan_sync_frame))) > 0) {
+        if (esp_wifi_80211_tx(WIFI_IF_AP,nan_sync_frame,length,true) != ESP_OK) {
             return false;
         }
     }
 
-    if ((length = odid_wifi_build_message_pack_nan_action_frame(&UAS_data,(char *)WiFi_mac_addr,
-                  ++send_counter_nan,
-                  buffer,sizeof(buffer))) > 0) {
-        if (esp_wifi_80211_tx(WIFI_IF_AP,buffer,length,true) != ESP_OK) {
-            return false;
-        }
+    ++send_counter_nan;
+    if (nan_frame_length == 0 || cache.get_pack_generation() != nan_pack_generation) {
+        uint16_t pack_length;
+        const uint8_t *pack = cache.get_pack(pack_length);
+        nan_frame_length = pack_length > 0 ? build_nan_action_frame(pack, pack_length) : 0;
+        nan_pack_generation = cache.get_pack_generation();
+    }
+    if (nan_frame_length <= 0) {
+        return true;
+    }
+
+    // both counters follow the send count, like the opendroneid builder
+    auto *si = (ODID_service_info *)(nan_frame + sizeof(ieee80211_mgmt) + sizeof(nan_service_discovery) +
+                                     sizeof(nan_service_descriptor_attribute));
+    si->message_counter = send_counter_nan;
+    auto *nsdea = (nan_service_descriptor_extension_attribute *)(nan_frame + nan_frame_length -
+                                                                  sizeof(nan_service_descriptor_extension_attribute));
+    nsdea->service_update_indicator = send_counter_nan;
+
+    if (esp_wifi_80211_tx(WIFI_IF_AP,nan_frame,nan_frame_length,true) != ESP_OK) {
+        return false;
     }
 
     return true;
 }
 
 //update the payload of the beacon frames in this function
-bool WiFi_TX::transmit_beacon(ODID_UAS_Data &UAS_data)
+bool WiFi_TX::transmit_beacon(const ODIDCache &cache)
 {
     init();
 
-    uint8_t buffer[1024] {};
+    uint16_t pack_length;
+    const uint8_t *pack = cache.get_pack(pack_length);
+    if (pack_length == 0) {
+        return false;
+    }
 
-    int length;
-    if ((length = odid_wifi_build_message_pack_beacon_frame(&UAS_data,(char *)WiFi_mac_addr,
-                   "UAS_ID_OPEN", strlen("UAS_ID_OPEN"), //use dummy SSID, as we only extract payload data
-                  1000/g.wifi_beacon_rate, ++send_counter_beacon, buffer, sizeof(buffer))) > 0) {
-
-        //set the RID IE element
-        uint8_t header_offset = 58;
-        vendor_ie_data_t IE_data;
-        IE_data.element_id = WIFI_VENDOR_IE_ELEMENT_ID;
-        IE_data.vendor_oui[0] = 0xFA;
-        IE_data.vendor_oui[1] = 0x0B;
-        IE_data.vendor_oui[2] = 0xBC;
-        IE_data.vendor_oui_type = 0x0D;
-        IE_data.length = length - header_offset + 4; //add 4 as of definition esp_wifi_set_vendor_ie
-        memcpy(IE_data.payload,&buffer[header_offset],length - header_offset);
-
-        // so first remove old element, add new afterwards
-        if (esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, &IE_data) != ESP_OK){
-            return false;
-        }
+    //set the RID IE element, the message counter followed by the message pack
+    uint8_t IE_buffer[sizeof(vendor_ie_data_t) + 1 + sizeof(ODID_MessagePack_encoded)] {};
+    vendor_ie_data_t &IE_data = *(vendor_ie_data_t *)IE_buffer;
+    IE_data.element_id = WIFI_VENDOR_IE_ELEMENT_ID;
+    IE_data.vendor_oui[0] = 0xFA;
+    IE_data.vendor_oui[1] = 0x0B;
+    IE_data.vendor_oui[2] = 0xBC;
+    IE_data.vendor_oui_type = 0x0D;
+    IE_data.length = 1 + pack_length + 4; //add 4 as of definition esp_wifi_set_vendor_ie
+    IE_data.payload[0] = ++send_counter_beacon;
+    memcpy(&IE_data.payload[1],pack,pack_length);
+
+    // so first remove old element, add new afterwards
+    if (esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, &IE_data) != ESP_OK){
+        return false;
+    }
 
-        if (esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, &IE_data) != ESP_OK){
-            return false;
-        }
+    if (esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_BEACON, WIFI_VND_IE_ID_0, &IE_data) != ESP_OK){
+        return false;
+    }
 
-        //set the payload also to probe requests, to increase update rate on mobile phones
-        // so first remove old element, add new afterwards
-        if (esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_PROBE_RESP, WIFI_VND_IE_ID_0, &IE_data) != ESP_OK){
-            return false;
-        }
+    //set the payload also to probe requests, to increase update rate on mobile phones
+    // so first remove old element, add new afterwards
+    if (esp_wifi_set_vendor_ie(false, WIFI_VND_IE_TYPE_PROBE_RESP, WIFI_VND_IE_ID_0, &IE_data) != ESP_OK){
+        return false;
+    }
 
-        if (esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_PROBE_RESP, WIFI_VND_IE_ID_0, &IE_data) != ESP_OK){
-            return false;
-        }
+    if (esp_wifi_set_vendor_ie(true, WIFI_VND_IE_TYPE_PROBE_RESP, WIFI_VND_IE_ID_0, &IE_data) != ESP_OK){
+        return false;
+    }
 
-        return true;
-	}
-	else {
-		return false;
-	}
+    return true;
 }
 
 
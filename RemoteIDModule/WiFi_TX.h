@@ -4,12 +4,16 @@
 #pragma once
 
 #include "transmitter.h"
+#include "odid_cache.h"
+
+#define NAN_FRAME_SIZE 512 // NAN action frame around the largest message pack
+#define NAN_SYNC_FRAME_SIZE 256 // NAN sync beacon, under 100 bytes
 
 class WiFi_TX : public Transmitter {
 public:
     bool init(void) override;
-    bool transmit_nan(ODID_UAS_Data &UAS_data);
-    bool transmit_beacon(ODID_UAS_Data &UAS_data);
+    bool transmit_nan(const ODIDCache &cache);
+    bool transmit_beacon(const ODIDCache &cache);
 
 private:
     bool initialised;
@@ -18,5 +22,14 @@ private:
     size_t ssid_length;
     uint8_t send_counter_nan;
     uint8_t send_counter_beacon;
+
+    // kept off the radio task stack
+    uint8_t nan_sync_frame[NAN_SYNC_FRAME_SIZE];
+
+    // the last NAN action frame, rebuilt when the message pack changes
+    uint8_t nan_frame[NAN_FRAME_SIZE];
+    int nan_frame_length;
+    uint32_t nan_pack_generation;
+    int build_nan_action_frame(const uint8_t *pack, uint16_t pack_length);
     uint8_t dBm_to_tx_power(float dBm) const;
 };
@@ -0,0 +1,225 @@
+/*
+  radio tasks for the WiFi and BLE broadcasts
+ */
+
+#include "broadcast.h"
+#include "parameters.h"
+
+void BroadcastSnapshot::publish(const ODID_UAS_Data &UAS_data, const ODIDCache &cache)
+{
+    seq++;
+    __sync_synchronize();
+    memcpy(&data.UAS_data, &UAS_data, sizeof(data.UAS_data));
+    data.cache = cache;
+    __sync_synchronize();
+    seq++;
+}
+
+bool BroadcastSnapshot::read(BroadcastData &data_out, uint32_t &last_seq) const
+{
+    while (true) {
+        const uint32_t s = seq;
+        if (s == last_seq) {
+            return false;
+        }
+        if (s & 1) {
+            // on a single core the writer needs to run to finish
+            vTaskDelay(1);
+            continue;
+        }
+        __sync_synchronize();
+        memcpy(&data_out, (const void *)&data, sizeof(data_out));
+        __sync_synchronize();
+        if (seq == s) {
+            last_seq = s;
+            return true;
+        }
+    }
+}
+
+BroadcastSnapshot Broadcaster::snapshot;
+uint32_t Broadcaster::published_generation;
+uint32_t Broadcaster::radios_params_gen;
+volatile bool Broadcaster::wifi_ready;
+volatile bool Broadcaster::ble_ready;
+
+WiFi_TX *Broadcaster::wifi;
+Broadcaster::Radio Broadcaster::wifi_radio;
+int8_t Broadcaster::wifi_nan_slot;
+int8_t Broadcaster::wifi_beacon_slot;
+
+BLE_TX *Broadcaster::ble;
+Broadcaster::Radio Broadcaster::ble_radio;
+int8_t Broadcaster::bt5_slot;
+int8_t Broadcaster::bt4_slot;
+int Broadcaster::bt4_states;
+
+void Broadcaster::init(WiFi_TX &_wifi, BLE_TX &_ble)
+{
+    wifi = &_wifi;
+    ble = &_ble;
+
+    // the periods are set from the parameters once we have data
+    const uint32_t now_ms = millis();
+    wifi_nan_slot = wifi_radio.scheduler.add(send_wifi_nan, 0, now_ms);
+    wifi_beacon_slot = wifi_radio.scheduler.add(send_wifi_beacon, 0, now_ms);
+    bt5_slot = ble_radio.scheduler.add(send_bt5, 0, now_ms);
+    bt4_slot = ble_radio.scheduler.add(send_bt4, 0, now_ms);
+
+    init_radios();
+    start_task(wifi_radio, wifi_task_main, "wifi_tx");
+    start_task(ble_radio, ble_task_main, "ble_tx");
+}
+
+/*
+  bring up the radios that have a rate set. WiFi and BT init need far
+  more stack than sending, so this runs here rather than on the radio
+  tasks, and again when the parameters change
+ */
+void Broadcaster::init_radios(void)
+{
+    radios_params_gen = Parameters::get_generation();
+    if (!wifi_ready && (g.wifi_nan_rate > 0 || g.wifi_beacon_rate > 0)) {
+        wifi->init();
+        __sync_synchronize();
+        wifi_ready = true;
+    }
+    if (!ble_ready && (g.bt4_rate > 0 || g.bt5_rate > 0)) {
+        ble->init();
+        __sync_synchronize();
+        ble_ready = true;
+    }
+}
+
+void Broadcaster::start_task(Radio &radio, TaskFunction_t fn, const char *name)
+{
+    if (xTaskCreatePinnedToCore(fn, name, RADIO_TASK_STACK, nullptr, RADIO_TASK_PRIORITY, &radio.task, RADIO_TASK_CORE) != pdPASS) {
+        Serial.printf("Failed to create %s task\n", name);
+        radio.task = nullptr;
+    }
+}
+
+void Broadcaster::publish(const ODID_UAS_Data &UAS_data, const ODIDCache &cache)
+{
+    if (Parameters::get_generation() != radios_params_gen) {
+        init_radios();
+    }
+
+    // the pack is rebuilt whenever anything the radios send changes
+    const uint32_t generation = cache.get_pack_generation();
+    if (generation == published_generation) {
+        return;
+    }
+    published_generation = generation;
+    snapshot.publish(UAS_data, cache);
+}
+
+/*
+  pick up new data just before sending, so it is no older than it
+  would be sending from loop()
+ */
+bool Broadcaster::refresh(Radio &radio)
+{
+    if (snapshot.read(radio.data, radio.seq)) {
+        radio.have_data = true;
+    }
+    return radio.have_data;
+}
+
+void Broadcaster::run(Radio &radio, void (*update_periods)(uint32_t now_ms))
+{
+    while (true) {
+        const uint32_t now_ms = millis();
+        const uint32_t params_gen = Parameters::get_generation();
+        if (radio.have_data && params_gen != radio.params_gen) {
+            radio.params_gen = params_gen;
+            update_periods(now_ms);
+        }
+        const uint32_t wait_ms = radio.scheduler.run(now_ms, RADIO_MAX_WAIT_MS);
+        vTaskDelay(max(pdMS_TO_TICKS(wait_ms), TickType_t(1)));
+    }
+}
+
+static uint32_t rate_to_period_ms(float rate)
+{
+    if (rate <= 0) {
+        return 0;
+    }
+    return max(uint32_t(1000 / rate), uint32_t(1));
+}
+
+void Broadcaster::wifi_task_main(void *arg)
+{
+    // wait for the first data before setting the periods
+    while (!refresh(wifi_radio)) {
+        vTaskDelay(pdMS_TO_TICKS(RADIO_MAX_WAIT_MS));
+    }
+    wifi_radio.params_gen = Parameters::get_generation();
+    wifi_update_periods(millis());
+    run(wifi_radio, wifi_update_periods);
+}
+
+void Broadcaster::wifi_update_periods(uint32_t now_ms)
+{
+    wifi_radio.scheduler.set_period(wifi_nan_slot, rate_to_period_ms(g.wifi_nan_rate), now_ms);
+    wifi_radio.scheduler.set_period(wifi_beacon_slot, rate_to_period_ms(g.wifi_beacon_rate), now_ms);
+}
+
+void Broadcaster::send_wifi_nan(uint32_t now_ms)
+{
+    if (!wifi_ready) {
+        return;
+    }
+    refresh(wifi_radio);
+    wifi->transmit_nan(wifi_radio.data.cache);
+}
+
+void Broadcaster::send_wifi_beacon(uint32_t now_ms)
+{
+    if (!wifi_ready) {
+        return;
+    }
+    refresh(wifi_radio);
+    wifi->transmit_beacon(wifi_radio.data.cache);
+}
+
+void Broadcaster::ble_task_main(void *arg)
+{
+    while (!refresh(ble_radio)) {
+        vTaskDelay(pdMS_TO_TICKS(RADIO_MAX_WAIT_MS));
+    }
+    ble_radio.params_gen = Parameters::get_generation();
+    ble_update_periods(millis());
+    run(ble_radio, ble_update_periods);
+}
+
+/*
+  BT4 cycles through one more message with a second BasicID
+ */
+void Broadcaster::ble_update_periods(uint32_t now_ms)
+{
+    bt4_states = ble_radio.data.UAS_data.BasicIDValid[1] ? 7 : 6;
+    ble_radio.scheduler.set_period(bt5_slot, rate_to_period_ms(g.bt5_rate), now_ms);
+    ble_radio.scheduler.set_period(bt4_slot, rate_to_period_ms(g.bt4_rate * bt4_states), now_ms);
+}
+
+void Broadcaster::send_bt5(uint32_t now_ms)
+{
+    if (!ble_ready) {
+        return;
+    }
+    refresh(ble_radio);
+    ble->transmit_longrange(ble_radio.data.cache);
+}
+
+void Broadcaster::send_bt4(uint32_t now_ms)
+{
+    if (!ble_ready) {
+        return;
+    }
+    refresh(ble_radio);
+    if ((ble_radio.data.UAS_data.BasicIDValid[1] ? 7 : 6) != bt4_states) {
+        ble_update_periods(now_ms);
+    }
+    ble->transmit_legacy(ble_radio.data.UAS_data, ble_radio.data.cache);
+}
@@ -0,0 +1,99 @@
+/*
+  radio tasks for the WiFi and BLE broadcasts
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <opendroneid.h>
+#include "odid_cache.h"
+#include "scheduler.h"
+#include "WiFi_TX.h"
+#include "BLE_TX.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define RADIO_TASK_STACK 4096 //Radio init runs on the loop task, not here
+#define RADIO_TASK_PRIORITY 2 //Above loop() and the geofence load, below the WiFi/BT stacks
+#define RADIO_TASK_CORE 0 //loop() parses MAVLink/CAN on the other core
+#define RADIO_MAX_WAIT_MS 100 //Longest sleep, so rate changes are seen
+
+// what the transmitters send from
+struct BroadcastData {
+    ODID_UAS_Data UAS_data;
+    ODIDCache cache;
+};
+
+/*
+  UAS data published by the loop task for the radio tasks. A seqlock:
+  the writer never waits, a reader retries if the data changed while it
+  was copying it
+ */
+class BroadcastSnapshot {
+public:
+    void publish(const ODID_UAS_Data &UAS_data, const ODIDCache &cache);
+
+    // copy the data if it changed since last_seq, false if unchanged
+    bool read(BroadcastData &data_out, uint32_t &last_seq) const;
+
+private:
+    volatile uint32_t seq; // odd while being written
+    BroadcastData data;
+};
+
+/*
+  WiFi and BLE each get a task with their own schedule and their own
+  copy of the snapshot, so a slow vendor IE update doesn't hold up BLE
+  and parsing MAVLink/CAN never holds up either
+ */
+class Broadcaster {
+public:
+    // start the radio tasks, the transmitters are used only from them afterwards
+    void init(WiFi_TX &wifi, BLE_TX &ble);
+
+    // new UAS data to send, called from the loop task after set_data()
+    void publish(const ODID_UAS_Data &UAS_data, const ODIDCache &cache);
+
+private:
+    struct Radio {
+        TaskHandle_t task;
+        Scheduler scheduler;
+        BroadcastData data;
+        uint32_t seq;
+        bool have_data;
+        uint32_t params_gen;
+    };
+
+    static void init_radios(void);
+    static void start_task(Radio &radio, TaskFunction_t fn, const char *name);
+    static void run(Radio &radio, void (*update_periods)(uint32_t now_ms));
+    static bool refresh(Radio &radio);
+
+    static void wifi_task_main(void *arg);
+    static void wifi_update_periods(uint32_t now_ms);
+    static void send_wifi_nan(uint32_t now_ms);
+    static void send_wifi_beacon(uint32_t now_ms);
+
+    static void ble_task_main(void *arg);
+    static void ble_update_periods(uint32_t now_ms);
+    static void send_bt5(uint32_t now_ms);
+    static void send_bt4(uint32_t now_ms);
+
+    static BroadcastSnapshot snapshot;
+    static uint32_t published_generation;
+    static uint32_t radios_params_gen;
+
+    // set once init() is done on the loop task, the tasks don't send before
+    static volatile bool wifi_ready;
+    static volatile bool ble_ready;
+
+    static WiFi_TX *wifi;
+    static Radio wifi_radio;
+    static int8_t wifi_nan_slot;
+    static int8_t wifi_beacon_slot;
+
+    static BLE_TX *ble;
+    static Radio ble_radio;
+    static int8_t bt5_slot;
+    static int8_t bt4_slot;
+    static int bt4_states;
+};
@@ -22,8 +22,74 @@ float DistanceCheck::haversine(double lat1, double lon1, double lat2, double lon
     return abs(EARTH_RADIUS * c);
 }
 
+void DistanceCheck::set_frame(LocalFrame &frame, double lat, double lon, float max_km) {
+    const float km_per_deg = EARTH_RADIUS * float(M_PI / 180.0);
+    const float max_lat = fabsf(float(lat)) + max_km / km_per_deg;
+
+    frame.lat0 = lat;
+    frame.lon0 = lon;
+    frame.lat0_ie7 = floatToiE7(lat);
+    frame.lon0_ie7 = floatToiE7(lon);
+    frame.km_per_deg_lat = km_per_deg;
+    frame.polar = max_lat >= APPROX_MAX_LAT;
+    frame.km_per_deg_lon = frame.polar ? 0 : km_per_deg * cosf(max_lat * float(M_PI / 180.0));
+}
+
+float DistanceCheck::approx_distance_sq(const LocalFrame &frame, double lat, double lon) {
+    if (frame.polar) {
+        return 0;
+    }
+    const float dlat = float(lat - frame.lat0);
+    float dlon = float(lon - frame.lon0);
+    if (dlon > 180) {
+        dlon -= 360;
+    } else if (dlon < -180) {
+        dlon += 360;
+    }
+    const float x = dlon * frame.km_per_deg_lon;
+    const float y = dlat * frame.km_per_deg_lat;
+    return x * x + y * y;
+}
+
+// Same estimate on 1e-7 degree coordinates, no double maths
+float DistanceCheck::approx_distance_sq(const LocalFrame &frame, int32_t lat, int32_t lon) {
+    if (frame.polar) {
+        return 0;
+    }
+    const float dlat = float(lat - frame.lat0_ie7) * 1.0e-7f;
+    int64_t dlon_ie7 = int64_t(lon) - frame.lon0_ie7;
+    if (dlon_ie7 > 1800000000LL) {
+        dlon_ie7 -= 3600000000LL;
+    } else if (dlon_ie7 < -1800000000LL) {
+        dlon_ie7 += 3600000000LL;
+    }
+    const float x = float(dlon_ie7) * 1.0e-7f * frame.km_per_deg_lon;
+    const float y = dlat * frame.km_per_deg_lat;
+    return x * x + y * y;
+}
+
+bool DistanceCheck::is_within(const LocalFrame &frame, double lat, double lon, float radius_km) {
+    const float limit = radius_km * APPROX_DISTANCE_MARGIN;
+    if (approx_distance_sq(frame, lat, lon) > limit * limit) {
+        return false;
+    }
+    return haversine(frame.lat0, frame.lon0, lat, lon) < radius_km;
+}
+
+bool DistanceCheck::is_within(const LocalFrame &frame, int32_t lat, int32_t lon, float radius_km) {
+    const float limit = radius_km * APPROX_DISTANCE_MARGIN;
+    if (approx_distance_sq(frame, lat, lon) > limit * limit) {
+        return false;
+    }
+    return haversine(frame.lat0, frame.lon0, iE7toFloat(lat), iE7toFloat(lon)) < radius_km;
+}
+
 double DistanceCheck::iE7toFloat(int32_t ie7){
     //return ie7 / 10000000.0;
     return ie7 * 1.0e-7;
-}  
+}
+
+int32_t DistanceCheck::floatToiE7(double deg){
+    return int32_t(lround(deg * 1.0e7));
+}
 #endif
\ No newline at end of file
@@ -2,13 +2,41 @@
 
 #if defined(BOARD_AURELIA_RID_S3)
 #include <math.h>
+#include <stdint.h>
 const float EARTH_RADIUS = 6371;
+const float APPROX_DISTANCE_MARGIN = 1.02; // Slack for the flat earth estimate before trusting a rejection
+const float APPROX_MAX_LAT = 89.0; // Past this the longitude scale collapses, only haversine is used
 
 class DistanceCheck{
     public:
     DistanceCheck(){};
+        /*
+          Local tangent plane around a reference point. Longitude is scaled at the
+          latitude closest to the pole within max_km, so inside that range the
+          estimate is never much longer than the real distance. A frame
+          reaching APPROX_MAX_LAT is polar and has no estimate
+         */
+        struct LocalFrame {
+            double lat0;
+            double lon0;
+            int32_t lat0_ie7;
+            int32_t lon0_ie7;
+            float km_per_deg_lat;
+            float km_per_deg_lon;
+            bool polar;
+        };
+
         float haversine(double lat1, double lon1, double lat2, double lon2);
         double iE7toFloat(int32_t ie7);
+        int32_t floatToiE7(double deg);
+
+        void set_frame(LocalFrame &frame, double lat, double lon, float max_km);
+        // Squared distance estimate in km^2, single precision only. 0 in a polar frame so nothing is rejected
+        float approx_distance_sq(const LocalFrame &frame, double lat, double lon);
+        float approx_distance_sq(const LocalFrame &frame, int32_t lat, int32_t lon);
+        // Cheap rejection first, haversine only for points close to radius_km
+        bool is_within(const LocalFrame &frame, double lat, double lon, float radius_km);
+        bool is_within(const LocalFrame &frame, int32_t lat, int32_t lon, float radius_km);
     private:
         double toRadians(double degree);
 };
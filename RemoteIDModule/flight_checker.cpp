@@ -7,248 +7,794 @@
 
 Coordinate FlightChecks::origin;
 
-uint16_t FlightChecks::country_coords_counter;
-uint16_t FlightChecks::country_coords_size;
-Coordinate *FlightChecks::country_coords = nullptr;
-
-uint16_t FlightChecks::airport_coords_counter;
-uint16_t FlightChecks::airport_coords_size;
-AirportCoordinate *FlightChecks::airport_coords = nullptr;
-
-uint16_t FlightChecks::prison_coords_counter;
-uint16_t FlightChecks::prison_coords_size;
-Coordinate *FlightChecks::prison_coords = nullptr;
+NearField FlightChecks::near_field[2];
+NearField *FlightChecks::active = &FlightChecks::near_field[0];
+NearField *FlightChecks::loading = &FlightChecks::near_field[1];
+NearFieldLoad FlightChecks::load;
+Coordinate FlightChecks::load_point;
+volatile uint8_t FlightChecks::load_progress;
+bool FlightChecks::load_busy;
+bool FlightChecks::load_failed;
+uint32_t FlightChecks::load_failed_ms;
+TaskHandle_t FlightChecks::load_task;
+QueueHandle_t FlightChecks::load_done;
 
 bool FlightChecks::files_read;
+bool FlightChecks::spiffs_begun;
+GeofenceImage FlightChecks::image;
+AirportRadii FlightChecks::airport_radii;
 
 void FlightChecks::init()
 {
-    country_coords_size = 16;
-    airport_coords_size = 16;
-    prison_coords_size = 16;
-    country_coords_counter = 0;
-    airport_coords_counter = 0;
-    prison_coords_counter = 0;
     files_read = false;
     origin = {0, 0};
-    if (country_coords != nullptr)
-    {
-        free(country_coords);
+    load_failed = false;
+    free_near_field(near_field[0]);
+    free_near_field(near_field[1]);
+    active = &near_field[0];
+    loading = &near_field[1];
+    update_airport_radii();
+    Parameters::set_float_change_hook(param_changed);
+
+    if (!image.map())
+    { // Older flash layouts only carry the text lists on SPIFFS
+        Serial.println("No geofence partition, using SPIFFS");
+        if (!mount_spiffs())
+        {
+            spiffs_mounted = false;
+        }
     }
-    if (airport_coords != nullptr)
-    {
-        free(airport_coords);
+
+    if (load_task == nullptr)
+    { // The geofence files are scanned on their own task so loop() keeps broadcasting
+        load_done = xQueueCreate(1, sizeof(LOAD_RESULT));
+        if (load_done == nullptr || xTaskCreatePinnedToCore(load_task_main, "geofence", LOAD_TASK_STACK, this, LOAD_TASK_PRIORITY, &load_task, LOAD_TASK_CORE) != pdPASS)
+        {
+            Serial.println("Failed to create geofence load task");
+            load_task = nullptr;
+        }
     }
-    if (prison_coords != nullptr)
+    load_busy = false;
+}
+
+void FlightChecks::load_task_main(void *arg)
+{ // Waits for a load request, fills the loading set and hands the result back to loop()
+    FlightChecks *fc = (FlightChecks *)arg;
+    while (true)
     {
-        free(prison_coords);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        load_progress = 0;
+        LOAD_RESULT result = fc->start_load(load_point) ? LOAD_RESULT::IN_PROGRESS : LOAD_RESULT::FAILED;
+        while (result == LOAD_RESULT::IN_PROGRESS)
+        {
+            result = fc->step_load(LOAD_SLICE_MS);
+            fc->update_load_progress();
+            vTaskDelay(1);
+        }
+        xQueueSend(load_done, &result, portMAX_DELAY);
     }
-    country_coords = (Coordinate *)malloc(country_coords_size * sizeof(Coordinate));
-    airport_coords = (AirportCoordinate *)malloc(airport_coords_size * sizeof(AirportCoordinate));
-    prison_coords = (Coordinate *)malloc(prison_coords_size * sizeof(Coordinate));
+}
 
-    if (!SPIFFS.begin(false))
+void FlightChecks::update_load_progress()
+{ // Each stage counts the same, the text lists also report how far into the file we are
+    const uint8_t stage_span = 100 / uint8_t(LOAD_STAGE::GRIDS);
+    if (load.stage == LOAD_STAGE::IDLE)
     {
-        Serial.println("An Error has occurred while mounting SPIFFS");
-        spiffs_mounted = false;
+        load_progress = 100;
+        return;
     }
+    uint8_t progress = (uint8_t(load.stage) - 1) * stage_span;
+    if (load.file && load.file.size() > 0)
+    {
+        progress += uint32_t(load.file.position()) * stage_span / load.file.size();
+    }
+    load_progress = progress;
+}
+
+void FlightChecks::free_near_field(NearField &nf)
+{
+    free(nf.country_lat);
+    free(nf.country_lon);
+    free(nf.airport_lat);
+    free(nf.airport_lon);
+    free(nf.airport_type);
+    free(nf.prison_lat);
+    free(nf.prison_lon);
+    free(nf.country_tiles);
+    free(nf.country_edges);
+    memset(&nf, 0, sizeof(nf));
 }
 
-bool FlightChecks::check_for_near_airports()
-{ // Reads a file with bunch of airports and only save the ones that the drone can reach in an object array
-    File full_airport_file = SPIFFS.open(FULL_AIRPORT_LIST, FILE_READ);
-    if (!full_airport_file)
+bool FlightChecks::start_load(const Coordinate &point)
+{ // Prepares the loading set to be filled with what the drone can reach from point
+    free_near_field(*loading);
+    loading->origin = point;
+    loading->country_coords_size = INITIAL_COORDS_SIZE;
+    loading->airport_coords_size = INITIAL_COORDS_SIZE;
+    loading->prison_coords_size = INITIAL_COORDS_SIZE;
+    loading->country_tiles_size = INITIAL_COORDS_SIZE;
+    loading->country_edges_size = INITIAL_COORDS_SIZE;
+    loading->country_lat = (int32_t *)malloc(loading->country_coords_size * sizeof(int32_t));
+    loading->country_lon = (int32_t *)malloc(loading->country_coords_size * sizeof(int32_t));
+    loading->airport_lat = (int32_t *)malloc(loading->airport_coords_size * sizeof(int32_t));
+    loading->airport_lon = (int32_t *)malloc(loading->airport_coords_size * sizeof(int32_t));
+    loading->airport_type = (uint8_t *)malloc(loading->airport_coords_size * sizeof(uint8_t));
+    loading->prison_lat = (int32_t *)malloc(loading->prison_coords_size * sizeof(int32_t));
+    loading->prison_lon = (int32_t *)malloc(loading->prison_coords_size * sizeof(int32_t));
+    loading->country_tiles = (GeofenceTile *)malloc(loading->country_tiles_size * sizeof(GeofenceTile));
+    loading->country_edges = (GeofenceEdge *)malloc(loading->country_edges_size * sizeof(GeofenceEdge));
+    if (loading->country_lat == nullptr || loading->country_lon == nullptr ||
+        loading->airport_lat == nullptr || loading->airport_lon == nullptr || loading->airport_type == nullptr ||
+        loading->prison_lat == nullptr || loading->prison_lon == nullptr ||
+        loading->country_tiles == nullptr || loading->country_edges == nullptr)
     {
-        Serial.println("Failed to open file");
-        delay(1000);
+        Serial.println("Near field malloc failed");
+        free_near_field(*loading);
         return false;
     }
 
-    if (full_airport_file.size() == 0)
+    dc.set_frame(load.frame, point.lat, point.lon, MAX_DRONE_DISTANCE);
+    return begin_load_stage(LOAD_STAGE::AIRPORTS);
+}
+
+void FlightChecks::close_load_sources()
+{
+    load.db.close();
+    load.tiles.close();
+    if (load.file)
     {
-        full_airport_file.close();
-        delay(1000);
-        return false;
+        load.file.close();
     }
+}
 
-    uint32_t last_wdt_reset = millis();
-
-    while (full_airport_file.available())
+bool FlightChecks::mount_spiffs()
+{
+    if (!spiffs_begun)
     {
-        String line = full_airport_file.readStringUntil('\n');
-        AirportCoordinate coord = parse_airport_coordinate(line);
-        if (dc.haversine(origin.lat, origin.lon, coord.lat, coord.lon) < MAX_DRONE_DISTANCE && airport_coords_size < MAX_CLOSE_AIRPORTS_SIZE)
+        spiffs_begun = SPIFFS.begin(false);
+        if (!spiffs_begun)
         {
-            if (airport_coords_counter >= airport_coords_size)
-            {
-                if (!double_coords_array(COORDS_ARRAY_ID::AIRPORT))
-                    return false;
-            }
-
-            airport_coords[airport_coords_counter] = coord;
-            // Debug
-            // Serial.printf("Saved: %.7f,%.7f\n", airport_coords[airport_coords_counter].lat, airport_coords[airport_coords_counter].lon);
-            airport_coords_counter++;
-            if (!check_airports)
-                check_airports = true;
+            Serial.println("An Error has occurred while mounting SPIFFS");
         }
-        reset_wdt(&last_wdt_reset);
     }
-    full_airport_file.close();
-    return true;
+    return spiffs_begun;
 }
 
-bool FlightChecks::check_for_near_prisons()
-{ // Reads a file with bunch of prisons and only save the ones that the drone can reach in an object array
-    File full_prison_file = SPIFFS.open(FULL_PRISON_LIST, FILE_READ);
-    if (!full_prison_file)
+bool FlightChecks::open_load_list(const char *path)
+{
+    if (!mount_spiffs())
+    {
+        return false;
+    }
+    load.file = SPIFFS.open(path, FILE_READ);
+    if (!load.file)
     {
         Serial.println("Failed to open file");
-        delay(1000);
         return false;
     }
 
-    if (full_prison_file.size() == 0)
+    if (load.file.size() == 0)
     {
-        full_prison_file.close();
-        delay(1000);
+        load.file.close();
         return false;
     }
+    load.reader.reset();
+    return true;
+}
 
-    uint32_t last_wdt_reset = millis();
+bool FlightChecks::begin_load_stage(LOAD_STAGE stage)
+{ // Opens what the stage reads from, bypassed checks are skipped
+    load.stage = stage;
+    switch (stage)
+    {
+    case LOAD_STAGE::AIRPORTS:
+        close_load_sources();
+        if (g.options & OPTIONS_BYPASS_AIRPORT_CHECKS)
+        {
+            return begin_load_stage(LOAD_STAGE::COUNTRY_TILES);
+        }
+        load.use_db = load.db.open(image, AIRPORT_DB);
+        if (load.use_db)
+        {
+            load.db.begin_query(load.query, loading->origin.lat, loading->origin.lon, MAX_DRONE_DISTANCE);
+            return true;
+        }
+        // Without the geofence partition only the text list is there
+        return open_load_list(FULL_AIRPORT_LIST);
+
+    case LOAD_STAGE::COUNTRY_TILES:
+        close_load_sources();
+        if (g.options & OPTIONS_BYPASS_COUNTRY_CHECKS)
+        {
+            return begin_load_stage(LOAD_STAGE::PRISONS);
+        }
+        if (load.tiles.open(image, COUNTRY_DB))
+        {
+            load.tiles.begin_query(load.tile_query, loading->origin.lat, loading->origin.lon, MAX_DRONE_DISTANCE);
+            return true;
+        }
+        // Without the geofence partition only the text list is there
+        return begin_load_stage(LOAD_STAGE::COUNTRY_INSIDE);
+
+    case LOAD_STAGE::COUNTRY_INSIDE:
+        close_load_sources();
+        load.inside = false;
+        load.is_first_coord = true;
+        load.polygon_count = 0;
+        return open_load_list(FULL_COUNTRY_LIST);
+
+    case LOAD_STAGE::COUNTRY_BORDERS:
+        // Same file, from the beginning
+        load.file.seek(0);
+        load.reader.reset();
+        load.prev_coord = {0, 0};
+        load.first_coord = {0, 0};
+        load.is_first_coord = true;
+        load.is_first_found_coord = false;
+        load.polygon_count = 0;
+        return true;
+
+    case LOAD_STAGE::PRISONS:
+        close_load_sources();
+        if (g.options & OPTIONS_BYPASS_PRISON_CHECKS)
+        {
+            return begin_load_stage(LOAD_STAGE::GRIDS);
+        }
+        load.use_db = load.db.open(image, PRISON_DB);
+        if (load.use_db)
+        {
+            load.db.begin_query(load.query, loading->origin.lat, loading->origin.lon, MAX_DRONE_DISTANCE);
+            return true;
+        }
+        // Without the geofence partition only the text list is there
+        return open_load_list(FULL_PRISON_LIST);
+
+    case LOAD_STAGE::GRIDS:
+    case LOAD_STAGE::IDLE:
+        close_load_sources();
+        return true;
+    }
+    return false;
+}
 
-    while (full_prison_file.available())
+LOAD_RESULT FlightChecks::step_load(uint32_t budget_ms)
+{ // Works on the loading set for up to budget_ms
+    const uint32_t start_ms = millis();
+    while (millis() - start_ms < budget_ms)
     {
-        String line = full_prison_file.readStringUntil('\n');
-        Coordinate coord = parse_coordinate(line);
-        if (dc.haversine(origin.lat, origin.lon, coord.lat, coord.lon) < MAX_DRONE_DISTANCE && prison_coords_size < MAX_CLOSE_PRISON_SIZE)
+        LOAD_RESULT result = LOAD_RESULT::FAILED;
+        LOAD_STAGE next_stage = LOAD_STAGE::IDLE;
+        switch (load.stage)
+        {
+        case LOAD_STAGE::AIRPORTS:
+            result = load_airport();
+            next_stage = LOAD_STAGE::COUNTRY_TILES;
+            break;
+        case LOAD_STAGE::COUNTRY_TILES:
+            result = load_country_tile();
+            next_stage = LOAD_STAGE::PRISONS;
+            break;
+        case LOAD_STAGE::COUNTRY_INSIDE:
+            result = load_country_inside();
+            next_stage = LOAD_STAGE::COUNTRY_BORDERS;
+            break;
+        case LOAD_STAGE::COUNTRY_BORDERS:
+            result = load_country_border();
+            next_stage = LOAD_STAGE::PRISONS;
+            break;
+        case LOAD_STAGE::PRISONS:
+            result = load_prison();
+            next_stage = LOAD_STAGE::GRIDS;
+            break;
+        case LOAD_STAGE::GRIDS:
+            build_grid(loading->airport_grid, loading->origin, loading->airport_lat, loading->airport_lon, loading->airport_type, loading->airport_coords_counter, max_airport_min_distance());
+            build_grid(loading->prison_grid, loading->origin, loading->prison_lat, loading->prison_lon, nullptr, loading->prison_coords_counter, g.min_prison_dis);
+            result = LOAD_RESULT::DONE;
+            next_stage = LOAD_STAGE::IDLE;
+            break;
+        case LOAD_STAGE::IDLE:
+            return LOAD_RESULT::DONE;
+        }
+
+        if (result == LOAD_RESULT::FAILED)
         {
-            if (prison_coords_counter >= prison_coords_size)
+            close_load_sources();
+            load.stage = LOAD_STAGE::IDLE;
+            return LOAD_RESULT::FAILED;
+        }
+        if (result == LOAD_RESULT::DONE)
+        {
+            if (!begin_load_stage(next_stage))
             {
-                if (!double_coords_array(COORDS_ARRAY_ID::PRISON))
-                    return false;
+                close_load_sources();
+                load.stage = LOAD_STAGE::IDLE;
+                return LOAD_RESULT::FAILED;
             }
+            if (load.stage == LOAD_STAGE::IDLE)
+            {
+                return LOAD_RESULT::DONE;
+            }
+        }
+    }
+    return LOAD_RESULT::IN_PROGRESS;
+}
 
-            prison_coords[prison_coords_counter] = coord;
+void FlightChecks::swap_near_field()
+{ // The checks only ever see a complete set
+    NearField *previous = active;
+    active = loading;
+    loading = previous;
+    free_near_field(*loading);
+}
+
+void FlightChecks::update_near_field()
+{ // Takes finished loads from the load task and asks for a new one at the first fix or once we've moved away from the load point
+    LOAD_RESULT result;
+    if (load_busy && xQueueReceive(load_done, &result, 0) == pdTRUE)
+    {
+        load_busy = false;
+        if (result == LOAD_RESULT::DONE)
+        {
+            swap_near_field();
             // Debug
-            // Serial.printf("Saved prison: %.7f,%.7f\n", prison_coords[prison_coords_counter].lat, prison_coords[prison_coords_counter].lon);
-            prison_coords_counter++;
-            if (!check_prisons)
-                check_prisons = true;
+            /*
+            for (int i = 0; i < active->country_coords_counter; i++)
+            {
+                Serial.printf("Save country coordinate %d: lat = %.7f, lon = %.7f\n", i + 1, dc.iE7toFloat(active->country_lat[i]), dc.iE7toFloat(active->country_lon[i]));
+            }
+
+            for (int i = 0; i < active->prison_coords_counter; i++)
+            {
+                Serial.printf("Save prison coordinate %d: lat = %.7f, lon = %.7f\n", i + 1, dc.iE7toFloat(active->prison_lat[i]), dc.iE7toFloat(active->prison_lon[i]));
+            }
+
+            for (int i = 0; i < active->airport_coords_counter; i++)
+            {
+                Serial.printf("Save airpot coordinate %d: lat = %.7f, lon = %.7f\n", i + 1, dc.iE7toFloat(active->airport_lat[i]), dc.iE7toFloat(active->airport_lon[i]));
+            }
+            */
+            load_failed = false;
+            files_read = true;
+        }
+        else
+        {
+            Serial.println("Near field load failed");
+            free_near_field(*loading);
+            load_failed = true;
+            load_failed_ms = millis();
+        }
+        return;
+    }
+
+    if (load_busy || (load_failed && millis() - load_failed_ms < LOAD_RETRY_MS))
+    {
+        return;
+    }
+    if (files_read && dc.haversine(active->origin.lat, active->origin.lon, origin.lat, origin.lon) < RECENTER_DISTANCE)
+    {
+        return;
+    }
+    if (load_task == nullptr)
+    {
+        load_failed = true;
+        load_failed_ms = millis();
+        return;
+    }
+    load_point = origin;
+    load_busy = true;
+    xTaskNotifyGive(load_task);
+}
+
+LOAD_RESULT FlightChecks::load_airport()
+{ // Saves the next airport the drone can reach
+    bool saved;
+    if (load.use_db)
+    {
+        const GeofenceRecord *rec;
+        if (!load.db.next(load.query, rec))
+        {
+            return LOAD_RESULT::DONE;
+        }
+        saved = save_near_airport(rec->lat, rec->lon, rec->type);
+    }
+    else
+    {
+        if (!load.reader.read_line(load.file, load.line, sizeof(load.line)))
+        {
+            return LOAD_RESULT::DONE;
         }
-        reset_wdt(&last_wdt_reset);
+        const AirportCoordinate coord = parse_airport_coordinate(load.line);
+        saved = save_near_airport(dc.floatToiE7(coord.lat), dc.floatToiE7(coord.lon), uint8_t(coord.type));
+    }
+    return saved ? LOAD_RESULT::IN_PROGRESS : LOAD_RESULT::FAILED;
+}
+
+bool FlightChecks::save_near_airport(int32_t lat, int32_t lon, uint8_t type)
+{ // Saves the airport in the object arrays if the drone can reach it
+    if (dc.is_within(load.frame, lat, lon, MAX_DRONE_DISTANCE) && loading->airport_coords_size < MAX_CLOSE_AIRPORTS_SIZE)
+    {
+        if (loading->airport_coords_counter >= loading->airport_coords_size)
+        {
+            if (!double_coords_array(*loading, COORDS_ARRAY_ID::AIRPORT))
+                return false;
+        }
+
+        loading->airport_lat[loading->airport_coords_counter] = lat;
+        loading->airport_lon[loading->airport_coords_counter] = lon;
+        loading->airport_type[loading->airport_coords_counter] = type;
+        // Debug
+        // Serial.printf("Saved: %.7f,%.7f\n", dc.iE7toFloat(lat), dc.iE7toFloat(lon));
+        loading->airport_coords_counter++;
+        loading->check_airports = true;
     }
-    full_prison_file.close();
     return true;
 }
 
-void FlightChecks::reset_wdt(uint32_t *last_reset)
-{ // Avoid wdt being triggered by setting a delay
-    uint32_t now = millis();
-    if (now - *last_reset > 500)
+LOAD_RESULT FlightChecks::load_prison()
+{ // Saves the next prison the drone can reach
+    bool saved;
+    if (load.use_db)
+    {
+        const GeofenceRecord *rec;
+        if (!load.db.next(load.query, rec))
+        {
+            return LOAD_RESULT::DONE;
+        }
+        saved = save_near_prison(rec->lat, rec->lon);
+    }
+    else
+    {
+        if (!load.reader.read_line(load.file, load.line, sizeof(load.line)))
+        {
+            return LOAD_RESULT::DONE;
+        }
+        const Coordinate coord = parse_coordinate(load.line);
+        saved = save_near_prison(dc.floatToiE7(coord.lat), dc.floatToiE7(coord.lon));
+    }
+    return saved ? LOAD_RESULT::IN_PROGRESS : LOAD_RESULT::FAILED;
+}
+
+bool FlightChecks::save_near_prison(int32_t lat, int32_t lon)
+{ // Saves the prison in the object arrays if the drone can reach it
+    if (dc.is_within(load.frame, lat, lon, MAX_DRONE_DISTANCE) && loading->prison_coords_size < MAX_CLOSE_PRISON_SIZE)
     {
-        t.set_fl_status(MAV_AURELIA_CHECK_STATUS_FAIL_FLYING_NOT_ALLOWED);
-        const char *init_msg = "Initializing";
-        t.set_parse_fail(init_msg);
-        t.update();
-        delay(1);
-        *last_reset = now;
+        if (loading->prison_coords_counter >= loading->prison_coords_size)
+        {
+            if (!double_coords_array(*loading, COORDS_ARRAY_ID::PRISON))
+                return false;
+        }
+
+        loading->prison_lat[loading->prison_coords_counter] = lat;
+        loading->prison_lon[loading->prison_coords_counter] = lon;
+        // Debug
+        // Serial.printf("Saved prison: %.7f,%.7f\n", dc.iE7toFloat(lat), dc.iE7toFloat(lon));
+        loading->prison_coords_counter++;
+        loading->check_prisons = true;
     }
+    return true;
 }
 
 bool FlightChecks::is_flying_near_a_prison()
 { // Checks if flying inside a prison area
-    for (uint16_t i = 0; i < prison_coords_counter; i++)
+    if (active->prison_grid.cell_km < g.min_prison_dis)
+    { // The cells no longer cover the restricted radius
+        build_grid(active->prison_grid, active->origin, active->prison_lat, active->prison_lon, nullptr, active->prison_coords_counter, g.min_prison_dis);
+    }
+
+    const CoordGrid &grid = active->prison_grid;
+    int16_t row_min, row_max, col_min, col_max;
+    if (!grid_neighbourhood(grid, row_min, row_max, col_min, col_max))
     {
-        if (dc.haversine(origin.lat, origin.lon, prison_coords[i].lat, prison_coords[i].lon) < g.min_prison_dis)
+        return false;
+    }
+    DistanceCheck::LocalFrame frame;
+    dc.set_frame(frame, origin.lat, origin.lon, g.min_prison_dis);
+    for (int16_t row = row_min; row <= row_max; row++)
+    { // Cells of a row are contiguous in the array
+        const uint16_t first = grid.cell_start[row * grid.cols + col_min];
+        const uint16_t last = grid.cell_start[row * grid.cols + col_max + 1];
+        for (uint16_t i = first; i < last; i++)
         {
-            return true;
+            if (dc.is_within(frame, active->prison_lat[i], active->prison_lon[i], g.min_prison_dis))
+            {
+                return true;
+            }
         }
     }
     return false;
 }
 
+float FlightChecks::airport_min_distance(AIRPORT_TYPE type)
+{ // Restricted radius around an airport, the test distance overrides all of them
+    if (g.min_test_airport_dis != 0)
+    {
+        return g.min_test_airport_dis;
+    }
+    switch (type)
+    {
+    case AIRPORT_TYPE::LARGE_AIRPORT:
+        return g.min_lg_airport_dis;
+    case AIRPORT_TYPE::MEDIUM_AIRPORT:
+        return g.min_md_airport_dis;
+    case AIRPORT_TYPE::SMALL_AIRPORT:
+        return g.min_sm_airport_dis;
+    case AIRPORT_TYPE::HELIPORT:
+        return g.min_hp_airport_dis;
+    case AIRPORT_TYPE::SEAPLANE_BASE:
+        return g.min_sp_airport_dis;
+    case AIRPORT_TYPE::HOTAIR_BALLOON_BASE:
+        return g.min_hb_airport_dis;
+    case AIRPORT_TYPE::TEST_FIELD:
+        return g.min_test_airport_dis;
+    }
+    return g.min_test_airport_dis;
+}
+
+void FlightChecks::update_airport_radii()
+{ // Saves the switch and the parameter reads for every airport on every check
+    airport_radii.max_radius_km = 0;
+    for (uint8_t type = 0; type < AIRPORT_TYPE_COUNT; type++)
+    {
+        const float radius = airport_min_distance(static_cast<AIRPORT_TYPE>(type));
+        const float limit = radius * APPROX_DISTANCE_MARGIN;
+        airport_radii.radius_km[type] = radius;
+        airport_radii.approx_limit_sq[type] = limit * limit;
+        airport_radii.max_radius_km = max(airport_radii.max_radius_km, radius);
+    }
+}
+
+void FlightChecks::param_changed(const Parameters::Param *p)
+{
+    if (strncmp(p->name, "MIN_", 4) == 0)
+    {
+        update_airport_radii();
+    }
+}
+
+float FlightChecks::max_airport_min_distance()
+{ // Largest restricted radius of any airport type, used to size the grid cells
+    if (g.min_test_airport_dis != 0)
+    {
+        return g.min_test_airport_dis;
+    }
+    float max_distance = g.min_lg_airport_dis;
+    max_distance = max(max_distance, g.min_md_airport_dis);
+    max_distance = max(max_distance, g.min_sm_airport_dis);
+    max_distance = max(max_distance, g.min_hp_airport_dis);
+    max_distance = max(max_distance, g.min_sp_airport_dis);
+    max_distance = max(max_distance, g.min_hb_airport_dis);
+    return max_distance;
+}
+
 bool FlightChecks::is_flying_near_an_airport()
 { // Checks if flying inside an airport area
-    for (uint16_t i = 0; i < airport_coords_counter; i++)
-    {
+    const float max_distance = airport_radii.max_radius_km;
+    if (active->airport_grid.cell_km < max_distance)
+    { // The cells no longer cover the restricted radius
+        build_grid(active->airport_grid, active->origin, active->airport_lat, active->airport_lon, active->airport_type, active->airport_coords_counter, max_distance);
+    }
 
-        float min_distance = g.min_test_airport_dis;
-        if (min_distance == 0)
+    const CoordGrid &grid = active->airport_grid;
+    int16_t row_min, row_max, col_min, col_max;
+    if (!grid_neighbourhood(grid, row_min, row_max, col_min, col_max))
+    {
+        return false;
+    }
+    DistanceCheck::LocalFrame frame;
+    dc.set_frame(frame, origin.lat, origin.lon, max_distance);
+    for (int16_t row = row_min; row <= row_max; row++)
+    { // Cells of a row are contiguous in the array
+        const uint16_t first = grid.cell_start[row * grid.cols + col_min];
+        const uint16_t last = grid.cell_start[row * grid.cols + col_max + 1];
+        for (uint16_t i = first; i < last; i++)
         {
-            switch (airport_coords[i].type)
+            // Unknown types get the test field radius, like airport_min_distance()
+            const uint8_t type = min(active->airport_type[i], uint8_t(AIRPORT_TYPE::TEST_FIELD));
+            if (dc.approx_distance_sq(frame, active->airport_lat[i], active->airport_lon[i]) <= airport_radii.approx_limit_sq[type] &&
+                dc.haversine(origin.lat, origin.lon, dc.iE7toFloat(active->airport_lat[i]), dc.iE7toFloat(active->airport_lon[i])) < airport_radii.radius_km[type])
             {
-            case AIRPORT_TYPE::LARGE_AIRPORT:
-                min_distance = g.min_lg_airport_dis;
-                break;
-            case AIRPORT_TYPE::MEDIUM_AIRPORT:
-                min_distance = g.min_md_airport_dis;
-                break;
-            case AIRPORT_TYPE::SMALL_AIRPORT:
-                min_distance = g.min_sm_airport_dis;
-                break;
-            case AIRPORT_TYPE::HELIPORT:
-                min_distance = g.min_hp_airport_dis;
-                break;
-            case AIRPORT_TYPE::SEAPLANE_BASE:
-                min_distance = g.min_sp_airport_dis;
-                break;
-            case AIRPORT_TYPE::HOTAIR_BALLOON_BASE:
-                min_distance = g.min_hb_airport_dis;
-                break;
-            case AIRPORT_TYPE::TEST_FIELD:
-                min_distance = g.min_test_airport_dis;
-                break;
+                return true;
             }
         }
-        if (dc.haversine(origin.lat, origin.lon, airport_coords[i].lat, airport_coords[i].lon) < min_distance)
-        {
-            return true;
-        }
     }
     return false;
 }
 
-uint8_t FlightChecks::is_inside_polygon_file(File countries_file)
-{ // The same as is_inside_polygon, but reading a spiffs file instead of an object array
-    bool inside = false;
-    Coordinate firstCoord;
-    Coordinate prevCoord;
-    bool isFirstCoord = true;
-    uint8_t polygon_count = 0;
+double FlightChecks::wrap_180(double angle)
+{
+    while (angle > 180)
+    {
+        angle -= 360;
+    }
+    while (angle < -180)
+    {
+        angle += 360;
+    }
+    return angle;
+}
+
+void FlightChecks::init_grid(CoordGrid &grid, const Coordinate &center, float radius_km)
+{ // Lays a grid over the area loaded around center, every cell is at least radius_km wide
+    const double km_per_deg = M_PI * EARTH_RADIUS / 180.0;
+    // Never use more cells than we have, the loaded area is 2*MAX_DRONE_DISTANCE wide plus a cell of padding each side
+    const float cell_km = max(radius_km, float(2 * MAX_DRONE_DISTANCE) / (GRID_CELLS - 2));
+    const double span_lat = MAX_DRONE_DISTANCE / km_per_deg;
+    // Size longitude cells at the latitude closest to the pole so they are wide enough everywhere
+    const double cos_lat = cos(degrees_to_radians(min(fabs(center.lat) + span_lat, 89.0)));
+    const double span_lon = min(span_lat / cos_lat, 180.0);
+
+    grid.cell_km = cell_km;
+    grid.cell_lat = cell_km / km_per_deg;
+    grid.cell_lon = cell_km / (km_per_deg * cos_lat);
+    grid.rows = min(int(ceil(2 * span_lat / grid.cell_lat)) + 2, GRID_CELLS);
+    grid.cols = min(int(ceil(2 * span_lon / grid.cell_lon)) + 2, GRID_CELLS);
+    grid.lat0 = center.lat - grid.rows * grid.cell_lat / 2;
+    grid.lon_ref = center.lon;
+    grid.lon0 = -grid.cols * grid.cell_lon / 2;
+}
+
+void FlightChecks::grid_cell(const CoordGrid &grid, double lat, double lon, int16_t &row, int16_t &col)
+{ // Cell of a coordinate, one row/column outside of the grid if it is not in it
+    row = constrain(floor((lat - grid.lat0) / grid.cell_lat), -1, grid.rows);
+    col = constrain(floor((wrap_180(lon - grid.lon_ref) - grid.lon0) / grid.cell_lon), -1, grid.cols);
+}
+
+bool FlightChecks::grid_neighbourhood(const CoordGrid &grid, int16_t &row_min, int16_t &row_max, int16_t &col_min, int16_t &col_max)
+{ // The 3x3 cells around origin clipped to the grid, false if none of them is in the grid
+    if (grid.rows == 1 && grid.cols == 1)
+    { // Single cell, it holds everything
+        row_min = row_max = col_min = col_max = 0;
+        return true;
+    }
+    int16_t row, col;
+    grid_cell(grid, origin.lat, origin.lon, row, col);
+    row_min = max(row - 1, 0);
+    row_max = min(row + 1, grid.rows - 1);
+    col_min = max(col - 1, 0);
+    col_max = min(col + 1, grid.cols - 1);
+    return row_min <= row_max && col_min <= col_max;
+}
+
+void FlightChecks::build_grid(CoordGrid &grid, const Coordinate &center, int32_t *lat, int32_t *lon, uint8_t *type, uint16_t count, float radius_km)
+{ // Sorts the coordinate arrays by cell (counting sort) and fills the cell offsets, type is optional
+    init_grid(grid, center, radius_km);
+    const uint16_t cells = grid.rows * grid.cols;
+    uint16_t *dest = (uint16_t *)malloc(max(count, uint16_t(1)) * sizeof(uint16_t));
+    int32_t *sorted = (int32_t *)malloc(max(count, uint16_t(1)) * sizeof(int32_t));
+    if (dest == nullptr || sorted == nullptr)
+    { // Not enough memory, use a single cell so the checks scan every entry
+        Serial.println("Grid malloc failed");
+        free(dest);
+        free(sorted);
+        grid.rows = 1;
+        grid.cols = 1;
+        grid.cell_km = INFINITY;
+        grid.cell_start[0] = 0;
+        grid.cell_start[1] = count;
+        return;
+    }
 
-    uint32_t last_wdt_reset = millis();
+    memset(grid.cell_start, 0, sizeof(grid.cell_start));
+    for (uint16_t i = 0; i < count; i++)
+    { // dest holds the cell for now
+        int16_t row, col;
+        grid_cell(grid, dc.iE7toFloat(lat[i]), dc.iE7toFloat(lon[i]), row, col);
+        row = constrain(row, 0, grid.rows - 1);
+        col = constrain(col, 0, grid.cols - 1);
+        dest[i] = row * grid.cols + col;
+        grid.cell_start[dest[i] + 1]++;
+    }
+    for (uint16_t c = 0; c < cells; c++)
+    {
+        grid.cell_start[c + 1] += grid.cell_start[c];
+    }
+    for (uint16_t i = 0; i < count; i++)
+    { // cell_start[c] is used as the insert position and ends up at the start of cell c+1
+        dest[i] = grid.cell_start[dest[i]]++;
+    }
+    for (uint16_t c = cells; c > 0; c--)
+    { // Shift back to get the start of each cell
+        grid.cell_start[c] = grid.cell_start[c - 1];
+    }
+    grid.cell_start[0] = 0;
 
-    while (countries_file.available())
+    // Move every array to its sorted position, one at a time through the same buffer
+    for (uint16_t i = 0; i < count; i++)
+    {
+        sorted[dest[i]] = lat[i];
+    }
+    memcpy(lat, sorted, count * sizeof(int32_t));
+    for (uint16_t i = 0; i < count; i++)
+    {
+        sorted[dest[i]] = lon[i];
+    }
+    memcpy(lon, sorted, count * sizeof(int32_t));
+    if (type != nullptr)
+    {
+        uint8_t *sorted_type = (uint8_t *)sorted;
+        for (uint16_t i = 0; i < count; i++)
+        {
+            sorted_type[dest[i]] = type[i];
+        }
+        memcpy(type, sorted_type, count * sizeof(uint8_t));
+    }
+    free(dest);
+    free(sorted);
+}
+
+LOAD_RESULT FlightChecks::load_country_tile()
+{ // Saves the next country tile the drone can reach with its edges
+    NearField &nf = *loading;
+    const GeofenceTile *found;
+    if (!load.tiles.next(load.tile_query, found))
+    {
+        return LOAD_RESULT::DONE;
+    }
+    GeofenceTile tile = *found;
+    if (nf.country_tiles_counter >= MAX_CLOSE_TILES_SIZE || nf.country_edges_counter + tile.edge_count > MAX_CLOSE_EDGES_SIZE)
+    { // Dropping tiles would give wrong answers, better to refuse
+        Serial.println("Too many country tiles");
+        return LOAD_RESULT::FAILED;
+    }
+    if (nf.country_tiles_counter >= nf.country_tiles_size)
+    {
+        if (!double_coords_array(nf, COORDS_ARRAY_ID::COUNTRY_TILE))
+            return LOAD_RESULT::FAILED;
+    }
+    while (nf.country_edges_counter + tile.edge_count > nf.country_edges_size)
+    {
+        if (!double_coords_array(nf, COORDS_ARRAY_ID::COUNTRY_EDGE))
+            return LOAD_RESULT::FAILED;
+    }
+    const GeofenceEdge *edges = load.tiles.edges(tile);
+    if (edges == nullptr)
     {
-        String line = countries_file.readStringUntil('\n');
-        if (line.startsWith("#"))
+        return LOAD_RESULT::FAILED;
+    }
+    memcpy(&nf.country_edges[nf.country_edges_counter], edges, tile.edge_count * sizeof(GeofenceEdge));
+    tile.first_edge = nf.country_edges_counter;
+    nf.country_edges_counter += tile.edge_count;
+    nf.country_tiles[nf.country_tiles_counter] = tile;
+    nf.country_tiles_counter++;
+    nf.check_countries = true;
+    return LOAD_RESULT::IN_PROGRESS;
+}
+
+LOAD_RESULT FlightChecks::load_country_inside()
+{ // Reads the next line of the country file looking for the banned country we are in, same as is_inside_polygon but on the file
+    const Coordinate &point = loading->origin;
+    const bool end_of_file = !load.reader.read_line(load.file, load.line, sizeof(load.line));
+    const char *line = load.line;
+    if (end_of_file || line[0] == '#')
+    { // The last polygon has no "#" after it
+        if (!load.is_first_coord)
         {
-            if (!isFirstCoord)
+            load.inside ^= checkEdge(point.lat, point.lon, load.prev_coord.lat, load.prev_coord.lon, load.first_coord.lat, load.first_coord.lon);
+            if (load.inside)
             {
-                inside ^= checkEdge(origin.lat, origin.lon, prevCoord.lat, prevCoord.lon, firstCoord.lat, firstCoord.lon);
-                if (inside)
-                {
-                    return polygon_count;
-                }
+                loading->is_inside_banned_country = load.polygon_count;
+                return LOAD_RESULT::DONE;
             }
-            polygon_count++;
-            isFirstCoord = true;
-            continue;
         }
-        if (isFirstCoord)
+        if (end_of_file)
         {
-            firstCoord = parse_coordinate(line);
-            prevCoord = firstCoord;
-            isFirstCoord = false;
-            continue;
+            return LOAD_RESULT::DONE;
         }
-        Coordinate currentCoord = parse_coordinate(line);
-        inside ^= checkEdge(origin.lat, origin.lon, prevCoord.lat, prevCoord.lon, currentCoord.lat, currentCoord.lon);
-        prevCoord = currentCoord;
-        reset_wdt(&last_wdt_reset);
+        load.polygon_count++;
+        load.is_first_coord = true;
+        return LOAD_RESULT::IN_PROGRESS;
     }
-    return 0;
+    if (load.is_first_coord)
+    {
+        load.first_coord = parse_coordinate(line);
+        load.prev_coord = load.first_coord;
+        load.is_first_coord = false;
+        return LOAD_RESULT::IN_PROGRESS;
+    }
+    Coordinate current_coord = parse_coordinate(line);
+    load.inside ^= checkEdge(point.lat, point.lon, load.prev_coord.lat, load.prev_coord.lon, current_coord.lat, current_coord.lon);
+    load.prev_coord = current_coord;
+    return LOAD_RESULT::IN_PROGRESS;
 }
 
 bool FlightChecks::checkEdge(double x, double y, double x1, double y1, double x2, double y2)
@@ -267,221 +813,230 @@ bool FlightChecks::checkEdge(double x, double y, double x1, double y1, double x2
     return false;
 }
 
-bool FlightChecks::check_for_near_countries()
-{
-    File file = SPIFFS.open(FULL_COUNTRY_LIST, FILE_READ);
-    if (!file)
-    {
-        Serial.println("Failed to open file");
-        delay(1000);
-        return false;
+LOAD_RESULT FlightChecks::load_country_border()
+{ // Reads the next line of the country file, saving the borders the drone can reach
+    NearField &nf = *loading;
+    if (!load.reader.read_line(load.file, load.line, sizeof(load.line)))
+    { // The last polygon has no "#" after it
+        return end_country_polygon(nf) ? LOAD_RESULT::DONE : LOAD_RESULT::FAILED;
+    }
+    const char *line = load.line;
+    if (line[0] == '#')
+    { // New polygon
+        if (!end_country_polygon(nf))
+        {
+            return LOAD_RESULT::FAILED;
+        }
+        load.polygon_count++;
+        load.is_first_coord = true;
+        load.is_first_found_coord = false;
+        return LOAD_RESULT::IN_PROGRESS;
     }
 
-    if (file.size() == 0)
+    // Fisrt coord of polygon
+    if (load.is_first_coord)
     {
-        file.close();
-        delay(1000);
-        return false;
+        load.coord1 = parse_coordinate(line);
+        load.is_first_coord = false;
+        return LOAD_RESULT::IN_PROGRESS;
     }
-    // First we check if we're inside a banned country and save which country is
-    is_inside_banned_country = is_inside_polygon_file(file);
-    // Reset the pointer on the file reading
-    file.seek(0);
-    bool startedRegion = false;
-
-    Coordinate coord1;
-    Coordinate coord2;
-    Coordinate prevCoord;
-    Coordinate firstCoord;
-
-    bool isFirstCoord = true;
-    bool isFirstFoundCoord = false;
-
-    uint8_t polygon_count = 0;
-    uint8_t current_polygon_offset = 0;
-
-    while (file.available())
-    {
-        String line = file.readStringUntil('\n');
-        if (line.startsWith("#"))
-        { // New polygon
-            if (prevCoord.lat != firstCoord.lat && prevCoord.lon != firstCoord.lon && isFirstFoundCoord)
-            { // The current Polygon isn't closed
-                // Check if enough space in object
-                if ((country_coords_counter + EXTRA_COORDINATES_CLOSE_POLYGON) >= country_coords_size)
-                {
-                    if (!double_coords_array(COORDS_ARRAY_ID::COUNTRY))
-                        return false;
-                }
-                close_polygon(firstCoord, prevCoord, polygon_count, current_polygon_offset);
-            }
-            else if (isFirstFoundCoord)
-            { // We have more than 1 polygon, then we separate it by a 0,0 coordinate
-                if (country_coords_counter >= country_coords_size)
-                {
-                    if (!double_coords_array(COORDS_ARRAY_ID::COUNTRY))
-                        return false;
-                }
-                country_coords[country_coords_counter] = {0, 0};
-                country_coords_counter++;
-            }
-            current_polygon_offset = country_coords_counter;
-            polygon_count++;
-            isFirstCoord = true;
-            isFirstFoundCoord = false;
-            continue;
+
+    // Check if the current coord hits a edge (with vertices on current coord and the previous one)
+    Coordinate coord2 = parse_coordinate(line);
+    if (distance_from_point_to_line_segment(nf.origin, load.coord1, coord2) < MAX_DRONE_DISTANCE && nf.country_coords_size < MAX_CLOSE_BORDERS_SIZE)
+    { // We only save those coordinates that the drone is able to reach
+        if ((nf.country_coords_counter + 1) >= nf.country_coords_size)
+        { // Double the object if neccesary
+            if (!double_coords_array(nf, COORDS_ARRAY_ID::COUNTRY))
+                return LOAD_RESULT::FAILED;
+        }
+        if (load.coord1.lat != load.prev_coord.lat && load.coord1.lon != load.prev_coord.lon)
+        { // None of the coords are already in the object
+            save_country_coord(nf, load.coord1);
+            save_country_coord(nf, coord2);
+        }
+        else
+        { // The first coordinate is already in object, we only save the second
+            save_country_coord(nf, coord2);
         }
 
-        // Fisrt coord of polygon
-        if (isFirstCoord)
+        if (!load.is_first_found_coord)
         {
-            coord1 = parse_coordinate(line);
-            isFirstCoord = false;
-            continue;
+            load.first_coord = load.coord1;
+            load.is_first_found_coord = true;
+            nf.check_countries = true;
         }
 
-        // Check if the current coord hits a edge (with vertices on current coord and the previous one)
-        coord2 = parse_coordinate(line);
-        if (distance_from_point_to_line_segment(coord1, coord2) < MAX_DRONE_DISTANCE && country_coords_size < MAX_CLOSE_BORDERS_SIZE)
-        { // We only save those coordinates that the drone is able to reach
-            if ((country_coords_counter + 1) >= country_coords_size)
-            { // Double the object if neccesary
-                if (!double_coords_array(COORDS_ARRAY_ID::COUNTRY))
-                    return false;
-            }
-            if (coord1.lat != prevCoord.lat && coord1.lon != prevCoord.lon)
-            { // None of the coords are already in the object
-                country_coords[country_coords_counter] = coord1;
-                country_coords_counter++;
-                country_coords[country_coords_counter] = coord2;
-                country_coords_counter++;
-            }
-            else
-            { // The first coordinate is already in object, we only save the second
-                country_coords[country_coords_counter] = coord2;
-                country_coords_counter++;
-            }
+        load.prev_coord = coord2;
+    }
 
-            if (!isFirstFoundCoord)
-            {
-                firstCoord = coord1;
-                isFirstFoundCoord = true;
-                check_countries = true;
-            }
+    // Update the previous coord
+    load.coord1 = coord2;
+    return LOAD_RESULT::IN_PROGRESS;
+}
 
-            prevCoord = coord2;
+bool FlightChecks::end_country_polygon(NearField &nf)
+{ // Closes the borders saved for the current polygon, if any, and adds it to the offset table
+    if (!load.is_first_found_coord)
+    {
+        return true;
+    }
+    if (nf.country_polygons >= MAX_CLOSE_POLYGONS)
+    {
+        Serial.println("Too many country polygons");
+        return false;
+    }
+    if (load.prev_coord.lat != load.first_coord.lat && load.prev_coord.lon != load.first_coord.lon)
+    { // The current Polygon isn't closed
+        // Check if enough space in object
+        if ((nf.country_coords_counter + EXTRA_COORDINATES_CLOSE_POLYGON) >= nf.country_coords_size)
+        {
+            if (!double_coords_array(nf, COORDS_ARRAY_ID::COUNTRY))
+                return false;
         }
-
-        // Update the previous coord
-        coord1 = coord2;
+        close_polygon(nf, nf.origin, load.first_coord, load.prev_coord);
+    }
+    else
+    {
+        nf.country_polygon_end[nf.country_polygons++] = nf.country_coords_counter;
     }
-
-    file.close();
     return true;
 }
 
-bool FlightChecks::double_coords_array(COORDS_ARRAY_ID coords_id)
+void FlightChecks::save_country_coord(NearField &nf, const Coordinate &coord)
 {
-    void **coord_ptr = nullptr;
-    uint16_t coord_size = 0;
-    size_t element_size = 0;
+    nf.country_lat[nf.country_coords_counter] = dc.floatToiE7(coord.lat);
+    nf.country_lon[nf.country_coords_counter] = dc.floatToiE7(coord.lon);
+    nf.country_coords_counter++;
+}
 
-    // Assing pointers and size depending on the object
+bool FlightChecks::grow_array(void **ptr, uint16_t size, size_t element_size)
+{
+    void *temp_ptr = realloc(*ptr, size * element_size);
+    if (temp_ptr == NULL)
+    {
+        Serial.println("Realloc failed");
+        free(*ptr);
+        *ptr = nullptr;
+        return false;
+    }
+    *ptr = temp_ptr;
+    return true;
+}
+
+bool FlightChecks::double_coords_array(NearField &nf, COORDS_ARRAY_ID coords_id)
+{
+    // Duplicate the size of every array of the object
     switch (coords_id)
     {
     case COORDS_ARRAY_ID::COUNTRY:
-        coord_ptr = (void **)&country_coords;
-        // Duplicate size
-        country_coords_size *= 2;
-        coord_size = country_coords_size;
-        element_size = sizeof(Coordinate);
-        break;
+        nf.country_coords_size *= 2;
+        return grow_array((void **)&nf.country_lat, nf.country_coords_size, sizeof(int32_t)) &&
+               grow_array((void **)&nf.country_lon, nf.country_coords_size, sizeof(int32_t));
 
     case COORDS_ARRAY_ID::AIRPORT:
-        coord_ptr = (void **)&airport_coords;
-        // Duplicate size
-        airport_coords_size *= 2;
-        coord_size = airport_coords_size;
-        element_size = sizeof(AirportCoordinate);
-        break;
+        nf.airport_coords_size *= 2;
+        return grow_array((void **)&nf.airport_lat, nf.airport_coords_size, sizeof(int32_t)) &&
+               grow_array((void **)&nf.airport_lon, nf.airport_coords_size, sizeof(int32_t)) &&
+               grow_array((void **)&nf.airport_type, nf.airport_coords_size, sizeof(uint8_t));
 
     case COORDS_ARRAY_ID::PRISON:
-        coord_ptr = (void **)&prison_coords;
-        // Duplicate size
-        prison_coords_size *= 2;
-        coord_size = prison_coords_size;
-        element_size = sizeof(Coordinate);
-        break;
-
-    default:
-        return false;
-    }
+        nf.prison_coords_size *= 2;
+        return grow_array((void **)&nf.prison_lat, nf.prison_coords_size, sizeof(int32_t)) &&
+               grow_array((void **)&nf.prison_lon, nf.prison_coords_size, sizeof(int32_t));
 
-    void *temp_ptr = realloc(*coord_ptr, (coord_size)*element_size);
-    if (temp_ptr == NULL)
-    {
-        Serial.println("Realloc failed");
-        free(*coord_ptr);
-        return false;
-    }
+    case COORDS_ARRAY_ID::COUNTRY_TILE:
+        nf.country_tiles_size *= 2;
+        return grow_array((void **)&nf.country_tiles, nf.country_tiles_size, sizeof(GeofenceTile));
 
-    // We just double size of the current object
-    *coord_ptr = temp_ptr;
-    return true;
+    case COORDS_ARRAY_ID::COUNTRY_EDGE:
+        nf.country_edges_size *= 2;
+        return grow_array((void **)&nf.country_edges, nf.country_edges_size, sizeof(GeofenceEdge));
+    }
+    return false;
 }
 
-bool FlightChecks::is_inside_polygon(uint8_t offset)
+bool FlightChecks::is_inside_polygon(const NearField &nf, const Coordinate &point, uint8_t first_polygon)
 {
-    if (country_coords_counter < 3)
+    if (nf.country_coords_counter < 3)
     { // It's not a polygon
         return false;
     }
 
-    bool inside_generated_polygon = false;
     int count = 0;
-    int next;
-    Coordinate firstCoordinate = {0, 0};
+    for (uint8_t p = first_polygon; p < nf.country_polygons; p++)
+    {
+        const uint16_t first = p > 0 ? nf.country_polygon_end[p - 1] : 0;
+        const uint16_t end = nf.country_polygon_end[p];
+        for (uint16_t i = first; i < end; i++)
+        { // The last vertex goes back to the first one
+            const uint16_t next = (i + 1 < end) ? i + 1 : first;
+            if (checkEdge(point.lat, point.lon, dc.iE7toFloat(nf.country_lat[i]), dc.iE7toFloat(nf.country_lon[i]),
+                          dc.iE7toFloat(nf.country_lat[next]), dc.iE7toFloat(nf.country_lon[next])))
+            { // Checks if the current location hits an edge
+                count++;
+            }
+        }
+    }
+    // ray-casting algorithm, if the number is odd, then we are inside a polygon
+    return count % 2 == 1;
+}
+
+bool FlightChecks::segments_cross(double lat1, double lon1, double lat2, double lon2, const GeofenceEdge &edge)
+{ // Proper crossing of two segments, a vertex lying on the other segment counts for one of its two edges only
+    const double a_lat = edge.lat1 * 1.0e-7;
+    const double a_lon = edge.lon1 * 1.0e-7;
+    const double b_lat = edge.lat2 * 1.0e-7;
+    const double b_lon = edge.lon2 * 1.0e-7;
+
+    const double d1 = (b_lat - a_lat) * (lon1 - a_lon) - (b_lon - a_lon) * (lat1 - a_lat);
+    const double d2 = (b_lat - a_lat) * (lon2 - a_lon) - (b_lon - a_lon) * (lat2 - a_lat);
+    if ((d1 > 0) == (d2 > 0))
+    {
+        return false;
+    }
+    const double d3 = (lat2 - lat1) * (a_lon - lon1) - (lon2 - lon1) * (a_lat - lat1);
+    const double d4 = (lat2 - lat1) * (b_lon - lon1) - (lon2 - lon1) * (b_lat - lat1);
+    return (d3 > 0) != (d4 > 0);
+}
 
-    for (int i = offset; i < country_coords_counter - 1; i++)
+bool FlightChecks::is_inside_country_tiles(const NearField &nf, const Coordinate &point)
+{ // Each tile knows if its centre is inside its polygon, every edge crossed on the way from the centre to us flips that
+    const uint16_t key = geofence_tile_key(point.lat, point.lon);
+    const double center_lat = (key / GEOFENCE_LON_BANDS) - 90 + 0.5;
+    const double center_lon = (key % GEOFENCE_LON_BANDS) - 180 + 0.5;
+    const double lat_min = min(point.lat, center_lat) * 1.0e7;
+    const double lat_max = max(point.lat, center_lat) * 1.0e7;
+    const double lon_min = min(point.lon, center_lon) * 1.0e7;
+    const double lon_max = max(point.lon, center_lon) * 1.0e7;
+
+    for (uint16_t i = 0; i < nf.country_tiles_counter; i++)
     {
-        if (country_coords[i].lat == 0 && country_coords[i].lon == 0)
-        { // We reached the beginning of the next polygon
-            firstCoordinate = {0, 0};
+        const GeofenceTile &tile = nf.country_tiles[i];
+        if (tile.key != key)
+        {
             continue;
         }
-        next = (i + 1);
-        if (country_coords[next].lat == 0 && country_coords[next].lon == 0)
-        { // We reached the end of the current polygon
-            if (checkEdge(origin.lat, origin.lon, country_coords[i].lat, country_coords[i].lon, firstCoordinate.lat, firstCoordinate.lon))
+        bool inside = tile.inside;
+        if (tile.box.lat_min <= lat_max && tile.box.lat_max >= lat_min && tile.box.lon_min <= lon_max && tile.box.lon_max >= lon_min)
+        { // Otherwise none of the edges can be in the way
+            for (uint16_t e = tile.first_edge; e < tile.first_edge + tile.edge_count; e++)
             {
-                count++;
+                inside ^= segments_cross(point.lat, point.lon, center_lat, center_lon, nf.country_edges[e]);
             }
         }
-        else
-        { // Process current polygon
-            if (firstCoordinate.lat == 0 && firstCoordinate.lon == 0)
-            { // Saves the first coordinate
-                firstCoordinate.lat = country_coords[i].lat;
-                firstCoordinate.lon = country_coords[i].lon;
-            }
-
-            if (checkEdge(origin.lat, origin.lon, country_coords[i].lat, country_coords[i].lon, country_coords[next].lat, country_coords[next].lon))
-            { // Checks if the current location hits an edge
-                count++;
-            }
+        if (inside)
+        {
+            return true;
         }
     }
-    if (count % 2 == 1)
-    { // ray-casting algorithm, if the number is odd, then we are inside a polygon
-        inside_generated_polygon = true;
-    }
-    return inside_generated_polygon;
+    return false;
 }
 
-void FlightChecks::close_polygon(Coordinate firstCoord, Coordinate lastCoord, uint8_t polygon_count, uint8_t offset)
+void FlightChecks::close_polygon(NearField &nf, const Coordinate &point, Coordinate firstCoord, Coordinate lastCoord)
 {
-    double bearing_first = calculate_bearing(origin.lat, origin.lon, firstCoord.lat, firstCoord.lon);
-    double bearing_last = calculate_bearing(origin.lat, origin.lon, lastCoord.lat, lastCoord.lon);
+    double bearing_first = calculate_bearing(point.lat, point.lon, firstCoord.lat, firstCoord.lon);
+    double bearing_last = calculate_bearing(point.lat, point.lon, lastCoord.lat, lastCoord.lon);
 
     Coordinate new_first_coord = destination_point(firstCoord.lat, firstCoord.lon, LINE_LENGHT, bearing_first);
     Coordinate new_last_coord = destination_point(lastCoord.lat, lastCoord.lon, LINE_LENGHT, bearing_last);
@@ -489,35 +1044,33 @@ void FlightChecks::close_polygon(Coordinate firstCoord, Coordinate lastCoord, ui
     double midpoint_lat = (new_first_coord.lat + new_last_coord.lat) / 2;
     double midpoint_lon = (new_first_coord.lon + new_last_coord.lon) / 2;
 
-    double bearing_origin_midpoint = calculate_bearing(origin.lat, origin.lon, midpoint_lat, midpoint_lon);
-    Coordinate close_polygon_a = destination_point(origin.lat, origin.lon, LINE_LENGHT, bearing_origin_midpoint);
-    country_coords[country_coords_counter] = new_last_coord;
-    country_coords_counter++;
-    country_coords[country_coords_counter] = close_polygon_a;
-    country_coords_counter++;
-    country_coords[country_coords_counter] = new_first_coord;
-    country_coords_counter++;
-    country_coords[country_coords_counter] = firstCoord;
-    country_coords_counter++;
-    country_coords[country_coords_counter] = {0, 0};
-    country_coords_counter++;
-    check_final_polygon(bearing_origin_midpoint, polygon_count, offset);
-}
-
-void FlightChecks::check_final_polygon(double bearing_origin_midpoint, uint8_t polygon_count, uint8_t offset)
-{                                                              // Checks if the current coordinate is inside or outside the final polygon depending on wether it is on a restricted area
-    bool inside_generated_polygon = is_inside_polygon(offset); // check if is inside the polygon
-    if ((inside_generated_polygon && is_inside_banned_country != polygon_count) || (!inside_generated_polygon && is_inside_banned_country == polygon_count))
+    double bearing_origin_midpoint = calculate_bearing(point.lat, point.lon, midpoint_lat, midpoint_lon);
+    Coordinate close_polygon_a = destination_point(point.lat, point.lon, LINE_LENGHT, bearing_origin_midpoint);
+    save_country_coord(nf, new_last_coord);
+    save_country_coord(nf, close_polygon_a);
+    save_country_coord(nf, new_first_coord);
+    save_country_coord(nf, firstCoord);
+    nf.country_polygon_end[nf.country_polygons] = nf.country_coords_counter;
+    nf.country_polygons++;
+    check_final_polygon(nf, point, bearing_origin_midpoint, load.polygon_count, nf.country_polygons - 1);
+}
+
+void FlightChecks::check_final_polygon(NearField &nf, const Coordinate &point, double bearing_origin_midpoint, uint8_t polygon_count, uint8_t polygon)
+{                                                                          // Checks if the current coordinate is inside or outside the final polygon depending on wether it is on a restricted area
+    bool inside_generated_polygon = is_inside_polygon(nf, point, polygon); // check if is inside the polygon
+    if ((inside_generated_polygon && nf.is_inside_banned_country != polygon_count) || (!inside_generated_polygon && nf.is_inside_banned_country == polygon_count))
     { // Changes a key coordinate to put in or take out the drone coordinate to the polygon
-        Coordinate close_polygon_b = destination_point(origin.lat, origin.lon, (LINE_LENGHT * -1), bearing_origin_midpoint);
-        country_coords[country_coords_counter - EXTRA_COORDINATES_CLOSE_POLYGON] = close_polygon_b;
+        Coordinate close_polygon_b = destination_point(point.lat, point.lon, (LINE_LENGHT * -1), bearing_origin_midpoint);
+        // close_polygon_a, the third coordinate from the end
+        nf.country_lat[nf.country_coords_counter - 3] = dc.floatToiE7(close_polygon_b.lat);
+        nf.country_lon[nf.country_coords_counter - 3] = dc.floatToiE7(close_polygon_b.lon);
     }
 }
 
-float FlightChecks::distance_from_point_to_line_segment(Coordinate coord1, Coordinate coord2)
+float FlightChecks::distance_from_point_to_line_segment(const Coordinate &point, Coordinate coord1, Coordinate coord2)
 {
-    double py = origin.lon;
-    double px = origin.lat;
+    double py = point.lon;
+    double px = point.lat;
     double y1 = coord1.lon;
     double x1 = coord1.lat;
     double y2 = coord2.lon;
@@ -542,30 +1095,35 @@ float FlightChecks::distance_from_point_to_line_segment(Coordinate coord1, Coord
     return dc.haversine(px, py, nearest_x, nearest_y);
 }
 
-Coordinate FlightChecks::parse_coordinate(String line)
-{
-    Coordinate coord;
-    int commaIndex = line.indexOf(',');
-    if (commaIndex != -1)
+Coordinate FlightChecks::parse_coordinate(const char *line)
+{ // "lat,lon", parsed in place
+    Coordinate coord = {0, 0};
+    const char *p = line;
+    int32_t lat, lon;
+    if (parse_ie7(p, lat) && *p++ == ',' && parse_ie7(p, lon))
     {
-        String latStr = line.substring(0, commaIndex);
-        String lonStr = line.substring(commaIndex + 1);
-        coord.lat = latStr.toDouble();
-        coord.lon = lonStr.toDouble();
+        coord.lat = dc.iE7toFloat(lat);
+        coord.lon = dc.iE7toFloat(lon);
     }
     return coord;
 }
 
-AirportCoordinate FlightChecks::parse_airport_coordinate(String line)
-{
-    AirportCoordinate coord;
-    int firstComma = line.indexOf(',');
-    int secondComma = line.indexOf(',', firstComma + 1);
-    if (firstComma != -1 && secondComma != -1)
+AirportCoordinate FlightChecks::parse_airport_coordinate(const char *line)
+{ // "type,lat,lon", parsed in place
+    AirportCoordinate coord = {};
+    char *p;
+    const long type = strtol(line, &p, 10);
+    if (p == line || *p++ != ',')
     {
-        coord.type = static_cast<AIRPORT_TYPE>(line.substring(0, firstComma).toInt());
-        coord.lat = line.substring(firstComma + 1, secondComma).toDouble();
-        coord.lon = line.substring(secondComma + 1).toDouble();
+        return coord;
+    }
+    const char *q = p;
+    int32_t lat, lon;
+    if (parse_ie7(q, lat) && *q++ == ',' && parse_ie7(q, lon))
+    {
+        coord.type = static_cast<AIRPORT_TYPE>(type);
+        coord.lat = dc.iE7toFloat(lat);
+        coord.lon = dc.iE7toFloat(lon);
     }
     return coord;
 }
@@ -640,71 +1198,37 @@ String FlightChecks::is_flying_allowed()
         return "GPS ";
     }
 
-    if (!files_read)
-    { // Only enters the first time when powered up
-        if (t.get_ack_request_status() == MAV_AURELIA_UTIL_ACK_REQUEST_DONE)
-        {
-            bool passed = true;
-            if (!(g.options & OPTIONS_BYPASS_AIRPORT_CHECKS))
-            {
-                passed &= check_for_near_airports();
-            }
-            if (!(g.options & OPTIONS_BYPASS_COUNTRY_CHECKS))
-            {
-                passed &= check_for_near_countries();
-            }
-            if (!(g.options & OPTIONS_BYPASS_PRISON_CHECKS))
-            {
-                passed &= check_for_near_prisons();
-            }
-            if (passed)
-            {
-                // Debug
-                /*
-                for (int i = 0; i < country_coords_counter; i++)
-                {
-                    Serial.printf("Save country coordinate %d: lat = %.7f, lon = %.7f\n", i + 1, country_coords[i].lat, country_coords[i].lon);
-                }
-
-                for (int i = 0; i < prison_coords_counter; i++)
-                {
-                    Serial.printf("Save prison coordinate %d: lat = %.7f, lon = %.7f\n", i + 1, prison_coords[i].lat, prison_coords[i].lon);
-                }
-
-                for (int i = 0; i < airport_coords_counter; i++)
-                {
-                    Serial.printf("Save airpot coordinate %d: lat = %.7f, lon = %.7f\n", i + 1, airport_coords[i].lat, airport_coords[i].lon);
-                }
-                */
-
-                files_read = true;
-            }
-            else
-            {
-                free(country_coords);
-                free(airport_coords);
-                free(prison_coords);
-                return "FILE ";
-            }
-        }
+    if (files_read || t.get_ack_request_status() == MAV_AURELIA_UTIL_ACK_REQUEST_DONE)
+    { // Loads the first set once the ack is done and keeps it centred on us afterwards
+        update_near_field();
+    }
+
+    if (!files_read && load_busy)
+    { // Still loading the first set
+        return "LOADING " + String(uint8_t(load_progress)) + "% ";
+    }
+
+    if (!files_read && load_failed)
+    {
+        return "FILE ";
     }
 
-    if (check_airports && !(g.options & OPTIONS_BYPASS_AIRPORT_CHECKS) ? is_flying_near_an_airport() : false)
+    if (active->check_airports && !(g.options & OPTIONS_BYPASS_AIRPORT_CHECKS) ? is_flying_near_an_airport() : false)
     {
         return "AIRPORT ";
     }
 
-    if (check_prisons && !(g.options & OPTIONS_BYPASS_PRISON_CHECKS) ? is_flying_near_a_prison() : false)
+    if (active->check_prisons && !(g.options & OPTIONS_BYPASS_PRISON_CHECKS) ? is_flying_near_a_prison() : false)
     {
         return "PRISON ";
     }
 
-    if (check_countries && !(g.options & OPTIONS_BYPASS_COUNTRY_CHECKS) ? is_inside_polygon() : is_inside_banned_country > 0 ? true
-                                                                             : false)
+    if (active->check_countries && !(g.options & OPTIONS_BYPASS_COUNTRY_CHECKS) ? (active->country_tiles_counter > 0 ? is_inside_country_tiles(*active, origin) : is_inside_polygon(*active, origin)) : active->is_inside_banned_country > 0 ? true
+                                                                                                                                                                                                   : false)
     {
         return "COUNTRY ";
     }
 
     return "";
 }
-#endif
\ No newline at end of file
+#endif
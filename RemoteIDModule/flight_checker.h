@@ -7,10 +7,18 @@
 #include <math.h>
 #include "spiffs_utils.h"
 #include "transport.h"
+#include "parameters.h"
+#include "geofence_db.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
 
 #define FULL_AIRPORT_LIST "/world_airport_list.txt"
 #define FULL_COUNTRY_LIST "/banned_countries.txt"
 #define FULL_PRISON_LIST "/world_prison_list.txt"
+#define AIRPORT_DB "airports.bin" // In the geofence partition, generated by scripts/make_geofence.py
+#define PRISON_DB "prisons.bin"
+#define COUNTRY_DB "countries.bin"
 
 #define LINE_LENGHT 200 //Distance (in Km) to which a new point will be projected to close the polygon
 #define MAX_DRONE_DISTANCE 55 // Maximum distance (in km) that the drone can travel before running out of battery
@@ -19,6 +27,19 @@
 #define MAX_CLOSE_AIRPORTS_SIZE 1024 //Maximum quantity of elements in airport coord object
 #define MAX_CLOSE_BORDERS_SIZE 1024 //Maximum quantity of elements in country coord object
 #define MAX_CLOSE_PRISON_SIZE 1024 //Maximum quantity of elements in prison coord object
+#define MAX_CLOSE_POLYGONS 32 //Maximum quantity of polygons in country coord object
+#define MAX_CLOSE_TILES_SIZE 256 //Maximum quantity of country tiles the drone can reach
+#define MAX_CLOSE_EDGES_SIZE 2048 //Maximum quantity of edges in those tiles
+#define GRID_CELLS 32 //Maximum cells per side of the near-field lookup grids
+#define INITIAL_COORDS_SIZE 16 //Elements allocated in each coord object when a load starts
+
+#define RECENTER_DISTANCE 15 //Distance (in Km) from the load point after which the near-field set is rebuilt
+#define LOAD_SLICE_MS 5 //Time the load task works before yielding for a tick
+#define LOAD_RETRY_MS 10000 //Wait before retrying a failed load
+#define LOAD_TASK_STACK 6144
+#define LOAD_TASK_PRIORITY 1 //Below the WiFi/BT stacks
+#define LOAD_TASK_CORE 0 //loop() runs on the other core
+#define LOAD_LINE_SIZE 64 //Longest text list line we care about
 
 enum class AIRPORT_TYPE : uint8_t
 {
@@ -31,11 +52,15 @@ enum class AIRPORT_TYPE : uint8_t
     TEST_FIELD = 6
 };
 
+#define AIRPORT_TYPE_COUNT 7
+
 enum class COORDS_ARRAY_ID : uint8_t
 {//For resizing objects
     AIRPORT = 0,
     COUNTRY = 1,
     PRISON = 2,
+    COUNTRY_TILE = 3,
+    COUNTRY_EDGE = 4,
 };
 
 typedef struct
@@ -51,6 +76,107 @@ typedef struct
     double lon;
 } AirportCoordinate;
 
+typedef struct
+{//Restricted radius of each AIRPORT_TYPE, only rebuilt when a MIN_* parameter changes
+    float radius_km[AIRPORT_TYPE_COUNT]; // For the haversine confirmation
+    float approx_limit_sq[AIRPORT_TYPE_COUNT]; // Same radius for DistanceCheck::approx_distance_sq, margin included
+    float max_radius_km;
+} AirportRadii;
+
+typedef struct
+{//Lat/lon buckets over a near-field coordinate array, the arrays are sorted by cell
+    double lat0; // South edge of the grid
+    double lon_ref; // Longitudes are taken relative to this one, so the grid can cross the antimeridian
+    double lon0; // West edge of the grid, relative to lon_ref
+    double cell_lat;
+    double cell_lon;
+    float cell_km; // Minimum cell size, a check can only look at the 3x3 cells around origin up to this radius
+    uint8_t rows;
+    uint8_t cols;
+    uint16_t cell_start[GRID_CELLS * GRID_CELLS + 1]; // Index of the first entry of each cell
+} CoordGrid;
+
+typedef struct
+{//Geofence entries the drone can reach from the point they were loaded around, coordinates in 1e-7 degrees as parallel arrays
+    Coordinate origin;
+
+    uint16_t country_coords_counter;
+    uint16_t country_coords_size;
+    int32_t *country_lat;
+    int32_t *country_lon;
+    uint8_t country_polygons;
+    uint16_t country_polygon_end[MAX_CLOSE_POLYGONS]; // Polygon p is [country_polygon_end[p-1], country_polygon_end[p])
+
+    uint16_t airport_coords_counter;
+    uint16_t airport_coords_size;
+    int32_t *airport_lat;
+    int32_t *airport_lon;
+    uint8_t *airport_type; // AIRPORT_TYPE
+
+    uint16_t prison_coords_counter;
+    uint16_t prison_coords_size;
+    int32_t *prison_lat;
+    int32_t *prison_lon;
+
+    // Country tiles from COUNTRY_DB, used instead of the country borders when present
+    uint16_t country_tiles_counter;
+    uint16_t country_tiles_size;
+    GeofenceTile *country_tiles; // first_edge indexes country_edges
+
+    uint16_t country_edges_counter;
+    uint16_t country_edges_size;
+    GeofenceEdge *country_edges;
+
+    CoordGrid airport_grid;
+    CoordGrid prison_grid;
+
+    uint8_t is_inside_banned_country;
+    bool check_airports;
+    bool check_countries;
+    bool check_prisons;
+} NearField;
+
+enum class LOAD_STAGE : uint8_t
+{//Steps of a near-field load, in order
+    IDLE = 0,
+    AIRPORTS = 1,
+    COUNTRY_TILES = 2, //Country tiles the drone can reach
+    COUNTRY_INSIDE = 3, //Which banned country we are in, text list only
+    COUNTRY_BORDERS = 4, //Borders the drone can reach, text list only
+    PRISONS = 5,
+    GRIDS = 6,
+};
+
+enum class LOAD_RESULT : uint8_t
+{
+    IN_PROGRESS = 0,
+    DONE = 1,
+    FAILED = 2,
+};
+
+struct NearFieldLoad
+{//State of a near-field load, kept between time slices
+    LOAD_STAGE stage;
+    DistanceCheck::LocalFrame frame;
+    GeofenceDB db;
+    GeofenceDB::Query query;
+    bool use_db;
+    CountryTileDB tiles;
+    CountryTileDB::Query tile_query;
+    File file;
+    LineReader reader;
+    char line[LOAD_LINE_SIZE];
+
+    // Country file scan
+    Coordinate coord1;
+    Coordinate prev_coord;
+    Coordinate first_coord;
+    bool is_first_coord;
+    bool is_first_found_coord;
+    bool inside;
+    uint8_t polygon_count;
+};
+
 class FlightChecks {
 public:
     FlightChecks(Transport &transport) : t(transport) {};
@@ -70,53 +196,80 @@ public:
     void init();
 
 private:
-    bool check_for_near_airports();
-    bool check_for_near_prisons();
-    bool check_for_near_countries();
+    static void load_task_main(void *arg);
+    bool start_load(const Coordinate &point);
+    LOAD_RESULT step_load(uint32_t budget_ms);
+    void update_load_progress();
+    bool begin_load_stage(LOAD_STAGE stage);
+    bool mount_spiffs();
+    bool open_load_list(const char *path);
+    void close_load_sources();
+    void update_near_field();
+    void swap_near_field();
+    void free_near_field(NearField &nf);
+
+    LOAD_RESULT load_airport();
+    LOAD_RESULT load_prison();
+    LOAD_RESULT load_country_tile();
+    LOAD_RESULT load_country_inside();
+    LOAD_RESULT load_country_border();
+    bool end_country_polygon(NearField &nf);
+    bool save_near_airport(int32_t lat, int32_t lon, uint8_t type);
+    bool save_near_prison(int32_t lat, int32_t lon);
 
     bool is_flying_near_an_airport();
     bool is_flying_near_a_prison();
-    uint8_t is_inside_polygon_file(File near_countries_file);
-    bool is_inside_polygon(uint8_t offset = 0);
+    static float airport_min_distance(AIRPORT_TYPE type);
+    static void update_airport_radii();
+    static void param_changed(const Parameters::Param *p);
+    float max_airport_min_distance();
+
+    void init_grid(CoordGrid &grid, const Coordinate &center, float radius_km);
+    void build_grid(CoordGrid &grid, const Coordinate &center, int32_t *lat, int32_t *lon, uint8_t *type, uint16_t count, float radius_km);
+    void grid_cell(const CoordGrid &grid, double lat, double lon, int16_t &row, int16_t &col);
+    bool grid_neighbourhood(const CoordGrid &grid, int16_t &row_min, int16_t &row_max, int16_t &col_min, int16_t &col_max);
+    double wrap_180(double angle);
+    bool is_inside_polygon(const NearField &nf, const Coordinate &point, uint8_t first_polygon = 0);
+    bool is_inside_country_tiles(const NearField &nf, const Coordinate &point);
+    bool segments_cross(double lat1, double lon1, double lat2, double lon2, const GeofenceEdge &edge);
 
     bool checkEdge(double x, double y, double x1, double y1, double x2, double y2);
-    float distance_from_point_to_line_segment(Coordinate coord1, Coordinate coord2);
+    float distance_from_point_to_line_segment(const Coordinate &point, Coordinate coord1, Coordinate coord2);
     double calculate_bearing(double lat1, double lon1, double lat2, double lon2);
     Coordinate destination_point(double lat, double lon, double distance, double bearing);
 
     double degrees_to_radians(double degrees);
     double radians_to_degrees(double radians);
 
-    bool double_coords_array(COORDS_ARRAY_ID coords_id);
+    bool double_coords_array(NearField &nf, COORDS_ARRAY_ID coords_id);
+    bool grow_array(void **ptr, uint16_t size, size_t element_size);
+    void save_country_coord(NearField &nf, const Coordinate &coord);
 
-    void close_polygon(Coordinate firstCoord, Coordinate lastCoord, uint8_t polygon_count, uint8_t offset);
-    void check_final_polygon(double bearing_origin_midpoint, uint8_t polygon_count, uint8_t offset);
+    void close_polygon(NearField &nf, const Coordinate &point, Coordinate firstCoord, Coordinate lastCoord);
+    void check_final_polygon(NearField &nf, const Coordinate &point, double bearing_origin_midpoint, uint8_t polygon_count, uint8_t polygon);
 
-    void reset_wdt(uint32_t *last_reset);
-
-    Coordinate parse_coordinate(String str);
-    AirportCoordinate parse_airport_coordinate(String line);
+    Coordinate parse_coordinate(const char *line);
+    AirportCoordinate parse_airport_coordinate(const char *line);
 
     static bool files_read;
-    bool check_airports = false;
-    bool check_countries = false;
-    bool check_prisons = false;
     bool spiffs_mounted = true;
-    uint8_t is_inside_banned_country = 0;
+    static bool spiffs_begun; // Only mounted when the text lists are needed
+    static GeofenceImage image;
+    static AirportRadii airport_radii;
 
     static Coordinate origin;
 
-    static uint16_t country_coords_counter;
-    static uint16_t country_coords_size;
-    static Coordinate *country_coords;
-
-    static uint16_t airport_coords_counter;
-    static uint16_t airport_coords_size;
-    static AirportCoordinate *airport_coords;
-
-    static uint16_t prison_coords_counter;
-    static uint16_t prison_coords_size;
-    static Coordinate *prison_coords;
+    static NearField near_field[2];
+    static NearField *active; // Set used by the checks, only touched by loop()
+    static NearField *loading; // Set being filled, only touched by the load task while a load is running
+    static NearFieldLoad load;
+    static Coordinate load_point;
+    static volatile uint8_t load_progress; // Percentage of the running load
+    static bool load_busy;
+    static bool load_failed;
+    static uint32_t load_failed_ms;
+    static TaskHandle_t load_task;
+    static QueueHandle_t load_done; // LOAD_RESULT of each finished load
 
     DistanceCheck dc;
     Transport &t;
@@ -0,0 +1,175 @@
+/*
+  append only flight time log in its own partition
+ */
+
+#include "flt_log.h"
+#include <Arduino.h>
+#include "parameters.h"
+#include "util.h"
+
+FltLog flt_log;
+
+void FltLog::init(void)
+{
+    part = esp_partition_find_first((esp_partition_type_t)FLTLOG_PARTITION_TYPE, ESP_PARTITION_SUBTYPE_ANY, FLTLOG_PARTITION_LABEL);
+    if (part == nullptr) {
+        return;
+    }
+    num_sectors = part->size / FLTLOG_SECTOR_SIZE;
+    if (num_sectors < 2) {
+        // the full sector holds the last record while the next is erased
+        part = nullptr;
+        return;
+    }
+    FltLogRecord last;
+    if (recover(last)) {
+        g.flt_time = last.flt_time;
+        g.flt_time_aux = last.flt_time_aux;
+        return;
+    }
+    // blank log, carry on from the values in NVS
+    next_index = 0;
+    seq = 0;
+    append(g.flt_time, g.flt_time_aux);
+}
+
+void FltLog::update(uint32_t flt_time, uint32_t flt_time_aux)
+{
+    if (append(flt_time, flt_time_aux)) {
+        g.flt_time = flt_time;
+        g.flt_time_aux = flt_time_aux;
+        return;
+    }
+    // stop using the log, so the parameter sets below go to NVS
+    part = nullptr;
+    g.set_by_name_uint32("FLT_TIME_AUX", flt_time_aux);
+    g.set_by_name_uint32("FLT_TIME", flt_time);
+}
+
+void FltLog::erase(void)
+{
+    // found again, the log may have been given up on since init()
+    const esp_partition_t *p = esp_partition_find_first((esp_partition_type_t)FLTLOG_PARTITION_TYPE, ESP_PARTITION_SUBTYPE_ANY, FLTLOG_PARTITION_LABEL);
+    if (p == nullptr) {
+        return;
+    }
+    if (esp_partition_erase_range(p, 0, p->size) != ESP_OK) {
+        Serial.printf("fltlog erase failed\n");
+    }
+}
+
+uint32_t FltLog::record_offset(uint32_t index)
+{
+    return (index / FLTLOG_RECORDS_PER_SECTOR) * FLTLOG_SECTOR_SIZE + (index % FLTLOG_RECORDS_PER_SECTOR) * sizeof(FltLogRecord);
+}
+
+bool FltLog::read_record(uint32_t index, FltLogRecord &rec) const
+{
+    return esp_partition_read(part, record_offset(index), &rec, sizeof(rec)) == ESP_OK;
+}
+
+bool FltLog::is_erased(uint32_t index) const
+{
+    FltLogRecord rec;
+    if (!read_record(index, rec)) {
+        return false;
+    }
+    const uint8_t *b = (const uint8_t *)&rec;
+    for (uint8_t i=0; i<sizeof(rec); i++) {
+        if (b[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t FltLog::record_crc(const FltLogRecord &rec)
+{
+    uint32_t words[offsetof(FltLogRecord, crc) / sizeof(uint32_t)];
+    memcpy(words, &rec, sizeof(words));
+    return uint32_t(crc_crc64(words, ARRAY_SIZE(words)));
+}
+
+bool FltLog::valid(const FltLogRecord &rec)
+{
+    return rec.crc == record_crc(rec);
+}
+
+/*
+  the newest sector is the one starting with the highest seq. Its
+  records are written in order from the start, so the first erased
+  slot is found with a binary search
+ */
+bool FltLog::recover(FltLogRecord &last)
+{
+    int32_t newest = -1;
+    uint32_t newest_seq = 0;
+    for (uint32_t s=0; s<num_sectors; s++) {
+        FltLogRecord rec;
+        if (read_record(s * FLTLOG_RECORDS_PER_SECTOR, rec) && valid(rec) &&
+            (newest < 0 || int32_t(rec.seq - newest_seq) > 0)) {
+            newest = s;
+            newest_seq = rec.seq;
+        }
+    }
+    if (newest < 0) {
+        return false;
+    }
+
+    const uint32_t first = newest * FLTLOG_RECORDS_PER_SECTOR;
+    uint32_t lo = 1;
+    uint32_t hi = FLTLOG_RECORDS_PER_SECTOR;
+    while (lo < hi) {
+        const uint32_t mid = (lo + hi) / 2;
+        if (is_erased(first + mid)) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    next_index = first + lo;
+
+    // a record cut short by a power loss fails its crc, use the one before
+    for (uint32_t i=lo; i>0; i--) {
+        FltLogRecord rec;
+        if (read_record(first + i - 1, rec) && valid(rec)) {
+            last = rec;
+            seq = rec.seq;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FltLog::append(uint32_t flt_time, uint32_t flt_time_aux)
+{
+    if (part == nullptr) {
+        return false;
+    }
+    if (next_index % FLTLOG_RECORDS_PER_SECTOR == 0) {
+        if (next_index >= num_sectors * FLTLOG_RECORDS_PER_SECTOR) {
+            next_index = 0;
+        }
+        // the oldest records go, the previous sector still has the last one
+        if (esp_partition_erase_range(part, (next_index / FLTLOG_RECORDS_PER_SECTOR) * FLTLOG_SECTOR_SIZE, FLTLOG_SECTOR_SIZE) != ESP_OK) {
+            Serial.printf("fltlog erase failed\n");
+            return false;
+        }
+    }
+    FltLogRecord rec;
+    rec.seq = seq + 1;
+    rec.flt_time = flt_time;
+    rec.flt_time_aux = flt_time_aux;
+    rec.uptime_ms = millis();
+    rec.crc = record_crc(rec);
+
+    const uint32_t offset = record_offset(next_index);
+    // the slot is used even if the write fails part way
+    next_index++;
+    if (esp_partition_write(part, offset, &rec, sizeof(rec)) != ESP_OK) {
+        Serial.printf("fltlog write failed\n");
+        return false;
+    }
+    seq = rec.seq;
+    return true;
+}
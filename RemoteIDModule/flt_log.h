@@ -0,0 +1,67 @@
+/*
+  append only flight time log in its own partition
+ */
+#pragma once
+
+#include <stdint.h>
+#include <esp_partition.h>
+
+#define FLTLOG_PARTITION_TYPE 0x48
+#define FLTLOG_PARTITION_LABEL "fltlog"
+#define FLTLOG_SECTOR_SIZE 4096
+
+/*
+  one record per flight time update. seq goes up by one per record,
+  crc is the low half of crc_crc64() over the words before it
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t seq;
+    uint32_t flt_time;
+    uint32_t flt_time_aux;
+    uint32_t uptime_ms;
+    uint32_t crc;
+} FltLogRecord;
+
+#define FLTLOG_RECORDS_PER_SECTOR (FLTLOG_SECTOR_SIZE / sizeof(FltLogRecord))
+
+/*
+  records are written in order into erased flash, one sector after the
+  other, and the sector after the full one is erased when we get to
+  it. So each update is a single small flash write with no read or
+  erase, and the wear is spread over the whole partition. A write cut
+  short by a power loss fails its crc and the record before it is used
+
+  without the partition (e.g. an older partition table updated over
+  OTA) FLT_TIME and FLT_TIME_AUX are kept in NVS as before. After a
+  failed flash write they go to NVS until the next boot
+ */
+class FltLog {
+public:
+    // find the last record and load it into g.flt_time/g.flt_time_aux
+    void init(void);
+
+    // store new flight time values, in the log or else in NVS
+    void update(uint32_t flt_time, uint32_t flt_time_aux);
+
+    // true while FLT_TIME and FLT_TIME_AUX are kept in the log
+    bool active(void) const { return part != nullptr; }
+
+    // erase every record, for a factory reset
+    void erase(void);
+
+private:
+    static uint32_t record_offset(uint32_t index);
+    bool read_record(uint32_t index, FltLogRecord &rec) const;
+    bool is_erased(uint32_t index) const;
+    static bool valid(const FltLogRecord &rec);
+    static uint32_t record_crc(const FltLogRecord &rec);
+    bool recover(FltLogRecord &last);
+    bool append(uint32_t flt_time, uint32_t flt_time_aux);
+
+    const esp_partition_t *part;
+    uint32_t num_sectors;
+    uint32_t next_index; // record slot for the next append
+    uint32_t seq;
+};
+
+extern FltLog flt_log;
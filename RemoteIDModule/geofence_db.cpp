@@ -0,0 +1,461 @@
+#include "geofence_db.h"
+
+#if defined(BOARD_AURELIA_RID_S3)
+#include <Arduino.h>
+#include <math.h>
+#include "distance_checker.h"
+
+#define DEG_IE7 10000000L
+#define LON_SEARCH_MARGIN 1.01 // widen the longitude window a bit, the haversine check is done by the caller
+
+bool GeofenceImage::map()
+{
+    if (base != nullptr)
+    {
+        return true;
+    }
+    const esp_partition_t *part = esp_partition_find_first((esp_partition_type_t)GEOFENCE_PARTITION_TYPE, ESP_PARTITION_SUBTYPE_ANY, GEOFENCE_PARTITION_LABEL);
+    if (part == nullptr)
+    {
+        return false;
+    }
+    const void *ptr = nullptr;
+    if (esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA, &ptr, &handle) != ESP_OK)
+    {
+        Serial.printf("mmap failed\n");
+        return false;
+    }
+    const GeofenceImageHeader *hdr = (const GeofenceImageHeader *)ptr;
+    if (hdr->magic != GEOFENCE_IMAGE_MAGIC ||
+        hdr->version != GEOFENCE_IMAGE_VERSION ||
+        hdr->image_size > part->size ||
+        sizeof(*hdr) + hdr->entry_count * sizeof(GeofenceImageEntry) > hdr->image_size)
+    {
+        // blank or stale partition
+        spi_flash_munmap(handle);
+        return false;
+    }
+    base = (const uint8_t *)ptr;
+    size = hdr->image_size;
+    return true;
+}
+
+bool GeofenceImage::find(const char *name, const uint8_t *&data, uint32_t &len) const
+{
+    if (base == nullptr)
+    {
+        return false;
+    }
+    const GeofenceImageHeader *hdr = (const GeofenceImageHeader *)base;
+    const GeofenceImageEntry *entries = (const GeofenceImageEntry *)(base + sizeof(*hdr));
+    for (uint16_t i = 0; i < hdr->entry_count; i++)
+    {
+        const GeofenceImageEntry &e = entries[i];
+        if (strncmp(e.name, name, GEOFENCE_NAME_LEN) == 0 && e.offset <= size && e.size <= size - e.offset)
+        {
+            data = base + e.offset;
+            len = e.size;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GeofenceDB::open(const GeofenceImage &image, const char *name)
+{
+    close();
+    const uint8_t *data;
+    uint32_t len;
+    if (!image.find(name, data, len))
+    {
+        return false;
+    }
+    const GeofenceDBHeader *hdr = (const GeofenceDBHeader *)data;
+    if (len < sizeof(*hdr) ||
+        hdr->magic != GEOFENCE_DB_MAGIC ||
+        hdr->version != GEOFENCE_DB_VERSION ||
+        hdr->record_size < sizeof(GeofenceRecord) ||
+        hdr->band_start[GEOFENCE_DB_BANDS] != hdr->record_count ||
+        len < sizeof(*hdr) + hdr->record_count * hdr->record_size)
+    {
+        Serial.printf("Bad geofence database %s\n", name);
+        return false;
+    }
+    header = hdr;
+    records = data + sizeof(*hdr);
+    return true;
+}
+
+/*
+  index of the first record in [first,last) with a longitude >= lon
+ */
+uint32_t GeofenceDB::lower_bound(uint32_t first, uint32_t last, int32_t lon) const
+{
+    while (first < last)
+    {
+        const uint32_t mid = first + (last - first) / 2;
+        if (record(mid)->lon < lon)
+        {
+            first = mid + 1;
+        }
+        else
+        {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+bool GeofenceDB::start_range(Query &q) const
+{
+    const uint32_t band_end = header->band_start[q.band + 1];
+    q.next = lower_bound(header->band_start[q.band], band_end, q.lon_min[q.range]);
+    q.end = band_end;
+    return q.next < q.end;
+}
+
+/*
+  latitude bands and longitude ranges (at most two, when crossing the
+  antimeridian) holding everything within radius_km of lat/lon
+ */
+static void search_window(double lat, double lon, float radius_km,
+                          int32_t lon_min[2], int32_t lon_max[2], uint8_t &lon_ranges,
+                          uint8_t &band_first, uint8_t &band_last)
+{
+    const double dlat = radius_km * (180.0 / (M_PI * EARTH_RADIUS));
+    const double lat_min = lat - dlat;
+    const double lat_max = lat + dlat;
+    int16_t first = int16_t(floor(lat_min)) + 90;
+    int16_t last = int16_t(floor(lat_max)) + 90;
+    band_first = constrain(first, 0, GEOFENCE_DB_BANDS - 1);
+    band_last = constrain(last, 0, GEOFENCE_DB_BANDS - 1);
+
+    // the longitude window is widest at the latitude closest to the pole
+    const double max_abs_lat = max(fabs(lat_min), fabs(lat_max));
+    double dlon = 180;
+    if (max_abs_lat < 89)
+    {
+        dlon = LON_SEARCH_MARGIN * dlat / cos(max_abs_lat * (M_PI / 180.0));
+    }
+
+    if (dlon >= 180)
+    {
+        lon_min[0] = -180 * DEG_IE7;
+        lon_max[0] = 180 * DEG_IE7;
+        lon_ranges = 1;
+    }
+    else if (lon - dlon < -180)
+    {
+        // window crosses the antimeridian on the west side
+        lon_min[0] = int32_t((lon - dlon + 360) * DEG_IE7);
+        lon_max[0] = 180 * DEG_IE7;
+        lon_min[1] = -180 * DEG_IE7;
+        lon_max[1] = int32_t((lon + dlon) * DEG_IE7);
+        lon_ranges = 2;
+    }
+    else if (lon + dlon > 180)
+    {
+        // window crosses the antimeridian on the east side
+        lon_min[0] = int32_t((lon - dlon) * DEG_IE7);
+        lon_max[0] = 180 * DEG_IE7;
+        lon_min[1] = -180 * DEG_IE7;
+        lon_max[1] = int32_t((lon + dlon - 360) * DEG_IE7);
+        lon_ranges = 2;
+    }
+    else
+    {
+        lon_min[0] = int32_t((lon - dlon) * DEG_IE7);
+        lon_max[0] = int32_t((lon + dlon) * DEG_IE7);
+        lon_ranges = 1;
+    }
+}
+
+static uint16_t lon_band(int32_t lon)
+{
+    const int32_t band = int32_t(floor(lon * 1.0e-7)) + 180;
+    return constrain(band, 0, GEOFENCE_LON_BANDS - 1);
+}
+
+uint16_t geofence_tile_key(double lat, double lon)
+{
+    const int16_t lat_band = constrain(int16_t(floor(lat)) + 90, 0, GEOFENCE_DB_BANDS - 1);
+    const int16_t lon_band = constrain(int16_t(floor(lon)) + 180, 0, GEOFENCE_LON_BANDS - 1);
+    return lat_band * GEOFENCE_LON_BANDS + lon_band;
+}
+
+void GeofenceDB::begin_query(Query &q, double lat, double lon, float radius_km) const
+{
+    memset(&q, 0, sizeof(q));
+    if (header == nullptr)
+    {
+        return;
+    }
+    search_window(lat, lon, radius_km, q.lon_min, q.lon_max, q.lon_ranges, q.band, q.band_last);
+    start_range(q);
+}
+
+bool GeofenceDB::next(Query &q, const GeofenceRecord *&rec) const
+{
+    if (q.lon_ranges == 0)
+    {
+        return false;
+    }
+    while (true)
+    {
+        if (q.next < q.end)
+        {
+            rec = record(q.next);
+            q.next++;
+            if (rec->lon <= q.lon_max[q.range])
+            {
+                return true;
+            }
+            // past the end of this longitude range
+            q.next = q.end;
+        }
+        // move on to the next longitude range, then to the next band
+        if (++q.range >= q.lon_ranges)
+        {
+            q.range = 0;
+            if (q.band >= q.band_last)
+            {
+                return false;
+            }
+            q.band++;
+        }
+        start_range(q);
+    }
+}
+
+bool CountryTileDB::open(const GeofenceImage &image, const char *name)
+{
+    close();
+    const uint8_t *data;
+    uint32_t len;
+    if (!image.find(name, data, len))
+    {
+        return false;
+    }
+    const CountryDBHeader *hdr = (const CountryDBHeader *)data;
+    if (len < sizeof(*hdr) ||
+        hdr->magic != COUNTRY_DB_MAGIC ||
+        hdr->version != COUNTRY_DB_VERSION ||
+        len != sizeof(*hdr) + hdr->polygon_count * sizeof(GeofenceBox) +
+               hdr->tile_count * sizeof(GeofenceTile) + hdr->edge_count * sizeof(GeofenceEdge))
+    {
+        Serial.printf("Bad country database %s\n", name);
+        return false;
+    }
+    header = hdr;
+    boxes = (const GeofenceBox *)(data + sizeof(*hdr));
+    tiles = (const GeofenceTile *)(boxes + hdr->polygon_count);
+    edge_table = (const GeofenceEdge *)(tiles + hdr->tile_count);
+    return true;
+}
+
+const GeofenceEdge *CountryTileDB::edges(const GeofenceTile &tile) const
+{
+    if (tile.first_edge + tile.edge_count > header->edge_count)
+    {
+        return nullptr;
+    }
+    return &edge_table[tile.first_edge];
+}
+
+/*
+  index of the first tile with a key >= key
+ */
+uint32_t CountryTileDB::lower_bound(uint16_t key) const
+{
+    uint32_t first = 0;
+    uint32_t last = header->tile_count;
+    while (first < last)
+    {
+        const uint32_t mid = first + (last - first) / 2;
+        if (tiles[mid].key < key)
+        {
+            first = mid + 1;
+        }
+        else
+        {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+void CountryTileDB::start_range(Query &q) const
+{
+    const uint16_t row = q.band * GEOFENCE_LON_BANDS;
+    q.next = lower_bound(row + lon_band(q.lon_min[q.range]));
+    q.key_max = row + lon_band(q.lon_max[q.range]);
+}
+
+/*
+  check the polygon bounding boxes first, most places are nowhere near
+  a banned country and don't need to look at the tiles at all
+ */
+bool CountryTileDB::polygons_near(const Query &q, int32_t lat_min, int32_t lat_max) const
+{
+    for (uint16_t i = 0; i < header->polygon_count; i++)
+    {
+        const GeofenceBox &box = boxes[i];
+        if (box.lat_max < lat_min || box.lat_min > lat_max)
+        {
+            continue;
+        }
+        for (uint8_t r = 0; r < q.lon_ranges; r++)
+        {
+            if (box.lon_max >= q.lon_min[r] && box.lon_min <= q.lon_max[r])
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void CountryTileDB::begin_query(Query &q, double lat, double lon, float radius_km) const
+{
+    memset(&q, 0, sizeof(q));
+    if (header == nullptr)
+    {
+        return;
+    }
+    search_window(lat, lon, radius_km, q.lon_min, q.lon_max, q.lon_ranges, q.band, q.band_last);
+    const int32_t lat_min = (int32_t(q.band) - 90) * DEG_IE7;
+    const int32_t lat_max = (int32_t(q.band_last) - 89) * DEG_IE7;
+    if (!polygons_near(q, lat_min, lat_max))
+    {
+        q.lon_ranges = 0;
+        return;
+    }
+    start_range(q);
+}
+
+bool CountryTileDB::next(Query &q, const GeofenceTile *&tile) const
+{
+    if (q.lon_ranges == 0)
+    {
+        return false;
+    }
+    while (true)
+    {
+        if (q.next < header->tile_count)
+        {
+            tile = &tiles[q.next];
+            if (tile->key <= q.key_max)
+            {
+                q.next++;
+                return true;
+            }
+        }
+        // move on to the next longitude range, then to the next band
+        if (++q.range >= q.lon_ranges)
+        {
+            q.range = 0;
+            if (q.band >= q.band_last)
+            {
+                return false;
+            }
+            q.band++;
+        }
+        start_range(q);
+    }
+}
+
+bool parse_ie7(const char *&p, int32_t &value)
+{
+    while (*p == ' ' || *p == '\t')
+    {
+        p++;
+    }
+    bool negative = false;
+    if (*p == '-' || *p == '+')
+    {
+        negative = (*p == '-');
+        p++;
+    }
+    int64_t v = 0;
+    bool digits = false;
+    while (isdigit(*p))
+    {
+        v = v * 10 + (*p++ - '0');
+        digits = true;
+        if (v > 180)
+        {
+            // not a coordinate, and past 214 degrees 1e-7 overflows int32_t
+            return false;
+        }
+    }
+    v *= DEG_IE7;
+    if (*p == '.')
+    {
+        p++;
+        int32_t scale = DEG_IE7 / 10;
+        bool round_up = false;
+        while (isdigit(*p))
+        {
+            const uint8_t d = *p++ - '0';
+            if (scale > 0)
+            {
+                v += d * scale;
+                scale /= 10;
+            }
+            else if (scale == 0)
+            {
+                // first digit past 1e-7 decides the rounding, the rest are skipped
+                round_up = (d >= 5);
+                scale = -1;
+            }
+            digits = true;
+        }
+        if (round_up)
+        {
+            v++;
+        }
+    }
+    value = negative ? -v : v;
+    return digits;
+}
+
+bool LineReader::fill(File &file)
+{
+    const int n = file.read((uint8_t *)buf, sizeof(buf));
+    if (n <= 0)
+    {
+        return false;
+    }
+    len = n;
+    pos = 0;
+    return true;
+}
+
+bool LineReader::read_line(File &file, char *line, size_t size)
+{
+    size_t n = 0;
+    bool found = false;
+    while (pos < len || fill(file))
+    {
+        found = true;
+        const char *start = buf + pos;
+        const char *end = (const char *)memchr(start, '\n', len - pos);
+        const size_t chunk = end ? end - start : len - pos;
+        const size_t copy = min(chunk, size - 1 - n);
+        memcpy(line + n, start, copy);
+        n += copy;
+        pos += chunk;
+        if (end)
+        {
+            pos++;
+            break;
+        }
+    }
+    if (n > 0 && line[n - 1] == '\r')
+    {
+        n--;
+    }
+    line[n] = 0;
+    return found;
+}
+#endif
@@ -0,0 +1,215 @@
+#pragma once
+
+#if defined(BOARD_AURELIA_RID_S3)
+#include <FS.h>
+#include <esp_partition.h>
+
+/*
+  binary geofence databases, generated by scripts/make_geofence.py and
+  flashed to their own partition. The partition is memory mapped so the
+  records are read in place, without a filesystem
+
+  fixed size records with 1e-7 degree coordinates, sorted by 1 degree
+  latitude band and then by longitude. The header holds the index of
+  the first record of each band, so a lookup is a binary search on
+  longitude in each band the drone can reach
+
+  banned countries are cut into 1 degree tiles, each tile record holds
+  the edges of a polygon crossing the tile and whether the tile centre
+  is inside the polygon. Tiles fully outside are not stored
+ */
+
+#define GEOFENCE_IMAGE_MAGIC 0x4D494647 // "GFIM"
+#define GEOFENCE_IMAGE_VERSION 1
+#define GEOFENCE_PARTITION_TYPE 0x47
+#define GEOFENCE_PARTITION_LABEL "geofence"
+#define GEOFENCE_NAME_LEN 16
+
+#define GEOFENCE_DB_MAGIC 0x42444647 // "GFDB"
+#define GEOFENCE_DB_VERSION 1
+#define GEOFENCE_DB_BANDS 180 // 1 degree latitude bands, band 0 starts at -90
+#define GEOFENCE_LON_BANDS 360 // 1 degree longitude bands for the tiles, band 0 starts at -180
+
+#define COUNTRY_DB_MAGIC 0x54434647 // "GFCT"
+#define COUNTRY_DB_VERSION 1
+
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_count;
+    uint32_t image_size;
+} GeofenceImageHeader;
+
+typedef struct __attribute__((packed))
+{
+    char name[GEOFENCE_NAME_LEN];
+    uint32_t offset; // from the start of the image
+    uint32_t size;
+} GeofenceImageEntry;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t record_count;
+    uint32_t band_start[GEOFENCE_DB_BANDS + 1];
+} GeofenceDBHeader;
+
+typedef struct __attribute__((packed))
+{
+    int32_t lat; // 1e-7 degrees
+    int32_t lon; // 1e-7 degrees
+    uint8_t type; // AIRPORT_TYPE for airports, 0 otherwise
+} GeofenceRecord;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t polygon_count;
+    uint32_t tile_count;
+    uint32_t edge_count;
+} CountryDBHeader;
+
+typedef struct __attribute__((packed))
+{
+    int32_t lat_min;
+    int32_t lon_min;
+    int32_t lat_max;
+    int32_t lon_max;
+} GeofenceBox;
+
+typedef struct __attribute__((packed))
+{
+    uint16_t key; // lat band * GEOFENCE_LON_BANDS + lon band
+    uint16_t polygon; // 1 based, in file order
+    uint8_t inside; // the tile centre is inside the polygon
+    GeofenceBox box; // of the edges, empty when there are none
+    uint32_t first_edge;
+    uint16_t edge_count;
+} GeofenceTile;
+
+typedef struct __attribute__((packed))
+{
+    int32_t lat1;
+    int32_t lon1;
+    int32_t lat2;
+    int32_t lon2;
+} GeofenceEdge;
+
+/*
+  the geofence partition, mapped once and left mapped
+ */
+class GeofenceImage {
+public:
+    bool map();
+    bool mapped() const { return base != nullptr; }
+    // find a database in the image by name
+    bool find(const char *name, const uint8_t *&data, uint32_t &size) const;
+
+private:
+    const uint8_t *base = nullptr;
+    uint32_t size;
+    spi_flash_mmap_handle_t handle;
+};
+
+// tile holding a coordinate (degrees)
+uint16_t geofence_tile_key(double lat, double lon);
+
+// parse a decimal degree value to 1e-7 degrees, p is left after the number
+bool parse_ie7(const char *&p, int32_t &value);
+
+class GeofenceDB {
+public:
+    /*
+      state of a search for records around a point, the drone can
+      only reach a few bands and at most two longitude ranges (when
+      crossing the antimeridian)
+     */
+    struct Query {
+        int32_t lon_min[2];
+        int32_t lon_max[2];
+        uint8_t lon_ranges;
+        uint8_t band;
+        uint8_t band_last;
+        uint8_t range;
+        uint32_t next;
+        uint32_t end;
+    };
+
+    bool open(const GeofenceImage &image, const char *name);
+    void close() { header = nullptr; }
+
+    // start a search for the records within radius_km of lat/lon (degrees)
+    void begin_query(Query &q, double lat, double lon, float radius_km) const;
+    // get the next candidate, the caller still has to check the distance
+    bool next(Query &q, const GeofenceRecord *&rec) const;
+
+private:
+    const GeofenceRecord *record(uint32_t idx) const
+    {
+        return (const GeofenceRecord *)(records + idx * header->record_size);
+    }
+    uint32_t lower_bound(uint32_t first, uint32_t last, int32_t lon) const;
+    bool start_range(Query &q) const;
+
+    const GeofenceDBHeader *header = nullptr;
+    const uint8_t *records;
+};
+
+class CountryTileDB {
+public:
+    // same idea as GeofenceDB::Query, over tile keys
+    struct Query {
+        int32_t lon_min[2];
+        int32_t lon_max[2];
+        uint8_t lon_ranges;
+        uint8_t band;
+        uint8_t band_last;
+        uint8_t range;
+        uint16_t key_max;
+        uint32_t next;
+    };
+
+    bool open(const GeofenceImage &image, const char *name);
+    void close() { header = nullptr; }
+
+    // start a search for the tiles within radius_km of lat/lon (degrees)
+    void begin_query(Query &q, double lat, double lon, float radius_km) const;
+    bool next(Query &q, const GeofenceTile *&tile) const;
+    // edges of a tile returned by next()
+    const GeofenceEdge *edges(const GeofenceTile &tile) const;
+
+private:
+    uint32_t lower_bound(uint16_t key) const;
+    void start_range(Query &q) const;
+    bool polygons_near(const Query &q, int32_t lat_min, int32_t lat_max) const;
+
+    const CountryDBHeader *header = nullptr;
+    const GeofenceBox *boxes;
+    const GeofenceTile *tiles;
+    const GeofenceEdge *edge_table;
+};
+
+#define LINE_READER_BUF_SIZE 512
+
+/*
+  reads the text lists in blocks, so the fallback path doesn't build a
+  String per line
+ */
+class LineReader {
+public:
+    void reset() { len = pos = 0; }
+    // copy the next line into line without the line ending, longer lines are cut. False at the end of the file
+    bool read_line(File &file, char *line, size_t size);
+
+private:
+    bool fill(File &file);
+
+    char buf[LINE_READER_BUF_SIZE];
+    uint16_t len;
+    uint16_t pos;
+};
+#endif
@@ -0,0 +1,234 @@
+/*
+  accuracy and speed of the flat earth distance estimate against
+  haversine. Random reference points at all latitudes, with targets
+  spread around each radius, check that the estimate never rejects a
+  point inside the radius and find the worst overshoot, which has to
+  stay under APPROX_DISTANCE_MARGIN
+ */
+
+#include <Arduino.h>
+#include <chrono>
+#include <random>
+#include <unistd.h>
+#include "../distance_checker.h"
+
+#define BENCH_PAIRS 1000000
+#define BENCH_MAX_KM 55 // MAX_DRONE_DISTANCE, the largest frame the checks use
+#define BENCH_TIMING_POINTS 4096
+#define BENCH_TIMING_REPEAT 200
+
+static DistanceCheck dc;
+static std::mt19937_64 rng(1);
+
+static double uniform(double lo, double hi)
+{
+    return std::uniform_real_distribution<double>(lo, hi)(rng);
+}
+
+static double to_rad(double deg)
+{
+    return deg * (M_PI / 180.0);
+}
+
+static double to_deg(double rad)
+{
+    return rad * (180.0 / M_PI);
+}
+
+// reference great circle distance, in double all the way through
+static double distance_km(double lat1, double lon1, double lat2, double lon2)
+{
+    const double dlat = to_rad(lat2 - lat1);
+    const double dlon = to_rad(lon2 - lon1);
+    const double a = sin(dlat/2) * sin(dlat/2) +
+        cos(to_rad(lat1)) * cos(to_rad(lat2)) * sin(dlon/2) * sin(dlon/2);
+    return 2 * EARTH_RADIUS * atan2(sqrt(a), sqrt(1 - a));
+}
+
+// the point dist_km away from lat,lon on a bearing
+static void destination(double lat, double lon, double bearing, double dist_km, double &lat2, double &lon2)
+{
+    const double d = dist_km / EARTH_RADIUS;
+    const double p1 = to_rad(lat);
+    const double p2 = asin(sin(p1) * cos(d) + cos(p1) * sin(d) * cos(bearing));
+    double l2 = to_rad(lon) + atan2(sin(bearing) * sin(d) * cos(p1), cos(d) - sin(p1) * sin(p2));
+    lat2 = to_deg(p2);
+    lon2 = fmod(to_deg(l2) + 540.0, 360.0) - 180.0;
+}
+
+static uint64_t now_ns(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Accuracy {
+    uint32_t pairs;
+    uint32_t inside;        // haversine puts the point inside the radius
+    uint32_t false_rejects; // inside, but the estimate said no
+    uint32_t polar;         // frames with no estimate
+    uint32_t prefiltered;   // outside and rejected without haversine
+    uint32_t outside;
+    double worst_ratio;     // largest estimate / real distance within max_km
+    double worst_lat;
+};
+
+/*
+  one reference point and frame, target points from 0 to twice the
+  frame range on random bearings so many land close to the radius
+ */
+static void check_pair(Accuracy &acc, bool ie7)
+{
+    // a quarter of the reference points within 3 degrees of a pole
+    const double lat = (rng() & 3) == 0 ? (rng() & 1 ? 1 : -1) * uniform(87, 90) : uniform(-90, 90);
+    const double lon = uniform(-180, 180);
+    const float max_km = uniform(0.5, BENCH_MAX_KM);
+    const float radius_km = uniform(0.1, max_km);
+
+    DistanceCheck::LocalFrame frame;
+    dc.set_frame(frame, lat, lon, max_km);
+
+    double lat2, lon2;
+    destination(lat, lon, uniform(0, 2 * M_PI), uniform(0, 2 * max_km), lat2, lon2);
+    if (ie7) {
+        // the airport and prison lists are stored as 1e-7 degrees
+        lat2 = dc.iE7toFloat(dc.floatToiE7(lat2));
+        lon2 = dc.iE7toFloat(dc.floatToiE7(lon2));
+    }
+    const double real_km = distance_km(frame.lat0, frame.lon0, lat2, lon2);
+    const float approx_sq = ie7 ?
+        dc.approx_distance_sq(frame, dc.floatToiE7(lat2), dc.floatToiE7(lon2)) :
+        dc.approx_distance_sq(frame, lat2, lon2);
+    const float limit = radius_km * APPROX_DISTANCE_MARGIN;
+    const bool rejected = approx_sq > limit * limit;
+    const bool within = ie7 ?
+        dc.is_within(frame, dc.floatToiE7(lat2), dc.floatToiE7(lon2), radius_km) :
+        dc.is_within(frame, lat2, lon2, radius_km);
+
+    acc.pairs++;
+    if (frame.polar) {
+        acc.polar++;
+    }
+    if (real_km < radius_km) {
+        acc.inside++;
+        if (rejected || !within) {
+            acc.false_rejects++;
+            if (acc.false_rejects <= 5) {
+                printf("false reject: %.7f,%.7f to %.7f,%.7f real %.4f km, estimate %.4f km, radius %.3f km\n",
+                       lat, lon, lat2, lon2, real_km, sqrt(approx_sq), radius_km);
+            }
+        }
+    } else {
+        acc.outside++;
+        if (rejected) {
+            acc.prefiltered++;
+        }
+    }
+    if (!frame.polar && real_km > 0.01 && real_km <= max_km) {
+        const double ratio = sqrt(approx_sq) / real_km;
+        if (ratio > acc.worst_ratio) {
+            acc.worst_ratio = ratio;
+            acc.worst_lat = lat;
+        }
+    }
+}
+
+static void print_accuracy(const char *name, const Accuracy &acc)
+{
+    printf("%-6s %8u pairs, %u inside, %u false rejects, %u polar frames, worst estimate/real %.5f at lat %.2f\n",
+           name, unsigned(acc.pairs), unsigned(acc.inside), unsigned(acc.false_rejects),
+           unsigned(acc.polar), acc.worst_ratio, acc.worst_lat);
+    printf("       %.1f%% of the points outside the radius were rejected without haversine\n",
+           acc.outside ? 100.0 * acc.prefiltered / acc.outside : 0);
+}
+
+/*
+  time per call of the estimate and of haversine, over points around a
+  mid latitude reference like the in-flight checks
+ */
+static void timing(void)
+{
+    DistanceCheck::LocalFrame frame;
+    dc.set_frame(frame, 47.4, 8.55, BENCH_MAX_KM);
+    std::vector<double> lat(BENCH_TIMING_POINTS), lon(BENCH_TIMING_POINTS);
+    std::vector<int32_t> lat_ie7(BENCH_TIMING_POINTS), lon_ie7(BENCH_TIMING_POINTS);
+    for (uint32_t i=0; i<BENCH_TIMING_POINTS; i++) {
+        destination(frame.lat0, frame.lon0, uniform(0, 2 * M_PI), uniform(0, 2 * BENCH_MAX_KM), lat[i], lon[i]);
+        lat_ie7[i] = dc.floatToiE7(lat[i]);
+        lon_ie7[i] = dc.floatToiE7(lon[i]);
+    }
+
+    volatile float sink = 0;
+    const uint32_t calls = BENCH_TIMING_POINTS * BENCH_TIMING_REPEAT;
+
+    uint64_t t0 = now_ns();
+    for (uint32_t r=0; r<BENCH_TIMING_REPEAT; r++) {
+        for (uint32_t i=0; i<BENCH_TIMING_POINTS; i++) {
+            sink = sink + dc.haversine(frame.lat0, frame.lon0, lat[i], lon[i]);
+        }
+    }
+    const double haversine_ns = double(now_ns() - t0) / calls;
+
+    t0 = now_ns();
+    for (uint32_t r=0; r<BENCH_TIMING_REPEAT; r++) {
+        for (uint32_t i=0; i<BENCH_TIMING_POINTS; i++) {
+            sink = sink + dc.approx_distance_sq(frame, lat[i], lon[i]);
+        }
+    }
+    const double approx_ns = double(now_ns() - t0) / calls;
+
+    t0 = now_ns();
+    for (uint32_t r=0; r<BENCH_TIMING_REPEAT; r++) {
+        for (uint32_t i=0; i<BENCH_TIMING_POINTS; i++) {
+            sink = sink + dc.approx_distance_sq(frame, lat_ie7[i], lon_ie7[i]);
+        }
+    }
+    const double approx_ie7_ns = double(now_ns() - t0) / calls;
+
+    t0 = now_ns();
+    for (uint32_t r=0; r<BENCH_TIMING_REPEAT; r++) {
+        for (uint32_t i=0; i<BENCH_TIMING_POINTS; i++) {
+            sink = sink + dc.is_within(frame, lat_ie7[i], lon_ie7[i], 5);
+        }
+    }
+    const double within_ns = double(now_ns() - t0) / calls;
+
+    printf("haversine %.1f ns, estimate %.1f ns, 1e-7 estimate %.1f ns, is_within(5 km) %.1f ns per point\n",
+           haversine_ns, approx_ns, approx_ie7_ns, within_ns);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t pairs = BENCH_PAIRS;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            pairs = strtoul(optarg, nullptr, 0);
+            break;
+        default:
+            printf("usage: bench_distance [-n pairs]\n");
+            return 1;
+        }
+    }
+
+    printf("margin %.3f, estimate used below %.1f degrees\n", APPROX_DISTANCE_MARGIN, APPROX_MAX_LAT);
+    Accuracy acc {}, acc_ie7 {};
+    for (uint32_t i=0; i<pairs; i++) {
+        check_pair(acc, false);
+        check_pair(acc_ie7, true);
+    }
+    print_accuracy("double", acc);
+    print_accuracy("1e-7", acc_ie7);
+    timing();
+
+    if (acc.false_rejects + acc_ie7.false_rejects > 0) {
+        printf("FAIL: points inside the radius were rejected\n");
+        return 1;
+    }
+    if (acc.worst_ratio > APPROX_DISTANCE_MARGIN || acc_ie7.worst_ratio > APPROX_DISTANCE_MARGIN) {
+        printf("FAIL: the estimate overshoots by more than the margin\n");
+        return 1;
+    }
+    return 0;
+}
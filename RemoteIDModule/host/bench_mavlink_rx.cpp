@@ -0,0 +1,308 @@
+/*
+  MAVLink framing benchmark. The same stream goes through
+  MAVLinkSerial::update() with the packets we don't handle skipped on
+  their length alone, then with every packet CRC checked, and the CPU
+  time and what was delivered are compared
+ */
+
+#include <Arduino.h>
+#include <chrono>
+#include <unistd.h>
+#include "../mavlink.h"
+#include "../parameters.h"
+#include "host_log.h"
+
+#define BENCH_UART_CHUNK 120 // the UART RX FIFO full threshold
+#define BENCH_ROUNDS 5
+#define BENCH_ATTITUDE_HZ 50 // unwanted packet rate of the made up stream
+#define BENCH_BAUDRATE 921600
+
+static MAVLinkSerial mavlink{Serial1, MAVLINK_COMM_0};
+
+enum Mode {
+    MODE_SKIP,
+    MODE_CRC,
+    MODE_COUNT
+};
+static const char *mode_names[MODE_COUNT] { "skip", "crc" };
+
+struct Result {
+    uint64_t ns; // best round
+    MAVLinkSerial::RxStats rx;
+    uint32_t delivered[uint8_t(Transport::MsgType::COUNT)];
+    uint32_t digest;
+};
+
+static uint64_t now_ns(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void digest_add(uint32_t &digest, const void *data, size_t len)
+{
+    // FNV-1a
+    const uint8_t *b = (const uint8_t *)data;
+    for (size_t i=0; i<len; i++) {
+        digest = (digest ^ b[i]) * 16777619U;
+    }
+}
+
+/*
+  fold the message of each type that was updated into the digest, so
+  the modes can be checked to deliver the same data
+ */
+static void digest_update(uint32_t &digest, uint32_t gen[])
+{
+    for (uint8_t i=0; i<uint8_t(Transport::MsgType::COUNT); i++) {
+        const auto type = Transport::MsgType(i);
+        const uint32_t g = mavlink.get_generation(type);
+        if (g == gen[i]) {
+            continue;
+        }
+        gen[i] = g;
+        digest_add(digest, &i, sizeof(i));
+        switch (type) {
+        case Transport::MsgType::LOCATION:
+            digest_add(digest, &mavlink.get_location(), sizeof(mavlink.get_location()));
+            break;
+        case Transport::MsgType::BASIC_ID:
+            digest_add(digest, &mavlink.get_basic_id(), sizeof(mavlink.get_basic_id()));
+            break;
+        case Transport::MsgType::AUTHENTICATION:
+            digest_add(digest, &mavlink.get_authentication(), sizeof(mavlink.get_authentication()));
+            break;
+        case Transport::MsgType::SELF_ID:
+            digest_add(digest, &mavlink.get_self_id(), sizeof(mavlink.get_self_id()));
+            break;
+        case Transport::MsgType::SYSTEM:
+            digest_add(digest, &mavlink.get_system(), sizeof(mavlink.get_system()));
+            break;
+        case Transport::MsgType::OPERATOR_ID:
+            digest_add(digest, &mavlink.get_operator_id(), sizeof(mavlink.get_operator_id()));
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/*
+  one pass over the stream, the UART filling the ring a FIFO at a time
+  and update() framing what is there. Only update() is timed
+ */
+static void run_round(const std::vector<uint8_t> &stream, Mode mode, Result &res)
+{
+    MAVLinkSerial::set_rx_skip_unwanted(mode == MODE_SKIP);
+
+    MAVLinkSerial::RxStats rx0, rx1;
+    MAVLinkSerial::get_rx_stats(rx0);
+    uint32_t gen0[uint8_t(Transport::MsgType::COUNT)];
+    uint32_t gen[uint8_t(Transport::MsgType::COUNT)];
+    for (uint8_t i=0; i<uint8_t(Transport::MsgType::COUNT); i++) {
+        gen0[i] = gen[i] = mavlink.get_generation(Transport::MsgType(i));
+    }
+
+    uint32_t digest = 2166136261U;
+    uint64_t ns = 0;
+    for (size_t ofs=0; ofs<stream.size(); ofs += BENCH_UART_CHUNK) {
+        const size_t len = std::min(size_t(BENCH_UART_CHUNK), stream.size() - ofs);
+        Serial1.host_receive(&stream[ofs], len);
+        const uint64_t t0 = now_ns();
+        mavlink.update();
+        ns += now_ns() - t0;
+        digest_update(digest, gen);
+    }
+
+    MAVLinkSerial::get_rx_stats(rx1);
+    res.rx.frames = rx1.frames - rx0.frames;
+    res.rx.skipped = rx1.skipped - rx0.skipped;
+    res.rx.crc_errors = rx1.crc_errors - rx0.crc_errors;
+    res.rx.ring_overflow = rx1.ring_overflow - rx0.ring_overflow;
+    for (uint8_t i=0; i<uint8_t(Transport::MsgType::COUNT); i++) {
+        res.delivered[i] = gen[i] - gen0[i];
+    }
+    res.digest = digest;
+    if (res.ns == 0 || ns < res.ns) {
+        res.ns = ns;
+    }
+}
+
+static void put_packet(std::vector<uint8_t> &stream, const mavlink_message_t &msg)
+{
+    uint8_t buf[MAVLINK_MAX_PACKET_LEN];
+    const uint16_t len = mavlink_msg_to_send_buffer(buf, &msg);
+    stream.insert(stream.end(), buf, buf + len);
+}
+
+/*
+  an autopilot link without a log to hand: ATTITUDE at 50Hz, which we
+  don't handle, with a heartbeat and the ODID messages at 1Hz
+ */
+static void make_stream(uint32_t seconds, std::vector<uint8_t> &stream)
+{
+    const uint8_t sysid = 1;
+    const uint8_t compid = 1;
+    mavlink_message_t msg;
+    for (uint32_t ms=0; ms<seconds*1000; ms += 1000 / BENCH_ATTITUDE_HZ) {
+        mavlink_msg_attitude_pack(sysid, compid, &msg, ms, 0.1, -0.2, 1.5 + ms * 1.0e-5, 0.01, 0.02, 0.03);
+        put_packet(stream, msg);
+        if (ms % 1000 != 0) {
+            continue;
+        }
+        mavlink_msg_heartbeat_pack(sysid, compid, &msg, MAV_TYPE_QUADROTOR, MAV_AUTOPILOT_ARDUPILOTMEGA, 0, 0, MAV_STATE_ACTIVE);
+        put_packet(stream, msg);
+
+        mavlink_open_drone_id_location_t location {};
+        location.status = MAV_ODID_STATUS_AIRBORNE;
+        location.latitude = -353632610 + int32_t(ms / 10);
+        location.longitude = 1491652300;
+        location.altitude_geodetic = 584;
+        location.timestamp = (ms / 1000) % 3600;
+        mavlink_msg_open_drone_id_location_encode(sysid, compid, &msg, &location);
+        put_packet(stream, msg);
+
+        mavlink_open_drone_id_basic_id_t basic_id {};
+        basic_id.id_type = MAV_ODID_ID_TYPE_SERIAL_NUMBER;
+        basic_id.ua_type = MAV_ODID_UA_TYPE_HELICOPTER_OR_MULTIROTOR;
+        strncpy((char *)basic_id.uas_id, "1581F0000BENCH", sizeof(basic_id.uas_id));
+        mavlink_msg_open_drone_id_basic_id_encode(sysid, compid, &msg, &basic_id);
+        put_packet(stream, msg);
+
+        mavlink_open_drone_id_self_id_t self_id {};
+        strncpy(self_id.description, "bench", sizeof(self_id.description));
+        mavlink_msg_open_drone_id_self_id_encode(sysid, compid, &msg, &self_id);
+        put_packet(stream, msg);
+
+        mavlink_open_drone_id_system_t system {};
+        system.operator_latitude = -353632000;
+        system.operator_longitude = 1491652000;
+        system.timestamp = ms / 1000 + 1;
+        mavlink_msg_open_drone_id_system_encode(sysid, compid, &msg, &system);
+        put_packet(stream, msg);
+
+        mavlink_open_drone_id_operator_id_t operator_id {};
+        strncpy(operator_id.operator_id, "OP-BENCH", sizeof(operator_id.operator_id));
+        mavlink_msg_open_drone_id_operator_id_encode(sysid, compid, &msg, &operator_id);
+        put_packet(stream, msg);
+    }
+}
+
+/*
+  line noise, one byte in every_n changed at random
+ */
+static uint32_t corrupt(std::vector<uint8_t> &stream, uint32_t every_n)
+{
+    uint32_t count = 0;
+    for (size_t ofs=random(every_n); ofs<stream.size(); ofs += 1 + random(2 * every_n)) {
+        stream[ofs] ^= uint8_t(1 + random(255));
+        count++;
+    }
+    return count;
+}
+
+static void usage(void)
+{
+    printf("usage: bench_mavlink_rx [-v] [-s seconds] [-e N] [-r rounds] [file]\n"
+           "  file     MAVLink .tlog or raw UART capture, else a stream is made up\n"
+           "  -s SEC   length of the made up stream (default 60)\n"
+           "  -e N     corrupt about one byte in N\n"
+           "  -r N     timed rounds per mode, the best is kept (default %u)\n"
+           "  -v       show the firmware console output\n",
+           BENCH_ROUNDS);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t seconds = 60;
+    uint32_t every_n = 0;
+    uint32_t rounds = BENCH_ROUNDS;
+    bool verbose = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:e:r:vh")) != -1) {
+        switch (opt) {
+        case 's':
+            seconds = strtoul(optarg, nullptr, 0);
+            break;
+        case 'e':
+            every_n = strtoul(optarg, nullptr, 0);
+            break;
+        case 'r':
+            rounds = strtoul(optarg, nullptr, 0);
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (rounds == 0) {
+        usage();
+        return 1;
+    }
+
+    host_set_console(verbose);
+    g.init();
+    mavlink.init();
+
+    std::vector<uint8_t> stream;
+    if (optind < argc) {
+        if (!host_load_mavlink(argv[optind], stream)) {
+            return 1;
+        }
+    } else {
+        make_stream(seconds, stream);
+    }
+    if (stream.empty()) {
+        fprintf(stderr, "empty stream\n");
+        return 1;
+    }
+    const uint32_t corrupted = every_n > 0 ? corrupt(stream, every_n) : 0;
+
+    // alternate the modes so clock and cache effects hit both
+    Result results[MODE_COUNT] {};
+    for (uint32_t r=0; r<rounds; r++) {
+        for (uint8_t m=0; m<MODE_COUNT; m++) {
+            run_round(stream, Mode(m), results[m]);
+        }
+    }
+
+    printf("stream %u bytes, %u corrupted, %u rounds\n",
+           unsigned(stream.size()), unsigned(corrupted), unsigned(rounds));
+    printf("%-5s %9s %9s %9s %9s %9s %10s\n",
+           "mode", "ns/byte", "ms", "frames", "skipped", "crc_err", "digest");
+    for (uint8_t m=0; m<MODE_COUNT; m++) {
+        const Result &res = results[m];
+        printf("%-5s %9.2f %9.3f %9u %9u %9u   %08x\n",
+               mode_names[m], double(res.ns) / stream.size(), res.ns * 1.0e-6,
+               unsigned(res.rx.frames), unsigned(res.rx.skipped), unsigned(res.rx.crc_errors),
+               unsigned(res.digest));
+    }
+
+    const Result &skip = results[MODE_SKIP];
+    const Result &crc = results[MODE_CRC];
+    const double saved_ns_per_byte = (double(crc.ns) - double(skip.ns)) / stream.size();
+    printf("skipping saves %.1f%% of the framing time, %.2f ns/byte, %.2f ms per second of link at %u baud\n",
+           crc.ns > 0 ? 100.0 * (double(crc.ns) - double(skip.ns)) / crc.ns : 0,
+           saved_ns_per_byte, saved_ns_per_byte * (BENCH_BAUDRATE / 10) * 1.0e-6,
+           unsigned(BENCH_BAUDRATE));
+
+    bool same = skip.digest == crc.digest && skip.rx.frames == crc.rx.frames;
+    for (uint8_t i=0; i<uint8_t(Transport::MsgType::COUNT); i++) {
+        if (skip.delivered[i] != crc.delivered[i]) {
+            printf("message type %u: %u delivered skipping, %u with the CRC\n",
+                   unsigned(i), unsigned(skip.delivered[i]), unsigned(crc.delivered[i]));
+            same = false;
+        }
+    }
+    if (!same) {
+        printf("the modes delivered different data\n");
+        // line noise can land on a skipped packet, a clean stream must match
+        return corrupted == 0 ? 1 : 0;
+    }
+    printf("both modes delivered the same data\n");
+    return 0;
+}
@@ -0,0 +1,339 @@
+/*
+  checks parse_ie7 against the String parsing it replaced, over hand
+  picked values and every line of the shipped lists, and times both
+  ways of reading the lists through the SPIFFS stand-in
+ */
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <chrono>
+#include <unistd.h>
+#include "host.h"
+#include "../geofence_db.h"
+#include "../distance_checker.h"
+#include "../util.h"
+
+// the lists as flashed to SPIFFS, see flight_checker.h
+#define BENCH_AIRPORT_LIST "/world_airport_list.txt"
+#define BENCH_PRISON_LIST "/world_prison_list.txt"
+#define BENCH_COUNTRY_LIST "/banned_countries.txt"
+#define BENCH_ROUNDS 5
+#define BENCH_MAX_PRINT 5
+
+static DistanceCheck dc;
+
+static uint64_t now_ns(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct ParseCase {
+    const char *text;
+    bool ok;
+    int32_t value;
+    char next; // where p has to be left
+};
+
+static const ParseCase cases[] = {
+    { "0", true, 0, 0 },
+    { "-0.5", true, -5000000, 0 },
+    { "12.3", true, 123000000, 0 },
+    { "-12.3456789", true, -123456789, 0 },
+    { ".5", true, 5000000, 0 },
+    { "  +7.1", true, 71000000, 0 },
+    { "\t-7.1", true, -71000000, 0 },
+    { "180", true, 1800000000, 0 },
+    { "-180", true, -1800000000, 0 },
+    // the 8th decimal rounds, away from zero on a tie
+    { "1.00000004", true, 10000000, 0 },
+    { "1.00000005", true, 10000001, 0 },
+    { "-1.00000005", true, -10000001, 0 },
+    { "1.000000049999", true, 10000000, 0 },
+    { "0.99999995", true, 10000000, 0 },
+    { "179.99999999", true, 1800000000, 0 },
+    { "-179.99999995", true, -1800000000, 0 },
+    { "7.747115999999999", true, 77471160, 0 },
+    { "12.5,3", true, 125000000, ',' },
+    { "12.5\r", true, 125000000, '\r' },
+    { "181", false, 0, 0 },
+    { "1000", false, 0, 0 },
+    { "-", false, 0, 0 },
+    { "abc", false, 0, 0 },
+    { "", false, 0, 0 },
+};
+
+static uint32_t check_cases(void)
+{
+    uint32_t failed = 0;
+    for (const auto &c : cases) {
+        const char *p = c.text;
+        int32_t value = 0;
+        const bool ok = parse_ie7(p, value);
+        if (ok != c.ok || (ok && (value != c.value || *p != c.next))) {
+            printf("parse_ie7(\"%s\") gave %s %d, left at '%c', expected %s %d\n",
+                   c.text, ok ? "true" : "false", int(value), *p ? *p : '0',
+                   c.ok ? "true" : "false", int(c.value));
+            failed++;
+        }
+    }
+    printf("%u of %u parse_ie7 cases passed\n", unsigned(ARRAY_SIZE(cases) - failed), unsigned(ARRAY_SIZE(cases)));
+    return failed;
+}
+
+/*
+  the parsing from before parse_ie7, a String per field and toDouble,
+  then floatToiE7 like the loaders
+ */
+static bool old_parse(const String &line, bool airport, long &type, int32_t &lat, int32_t &lon)
+{
+    int comma = line.indexOf(',');
+    if (comma == -1) {
+        return false;
+    }
+    String rest = line;
+    if (airport) {
+        type = line.substring(0, comma).toInt();
+        rest = line.substring(comma + 1);
+        comma = rest.indexOf(',');
+        if (comma == -1) {
+            return false;
+        }
+    }
+    lat = dc.floatToiE7(rest.substring(0, comma).toDouble());
+    lon = dc.floatToiE7(rest.substring(comma + 1).toDouble());
+    return true;
+}
+
+// parse_coordinate and parse_airport_coordinate from flight_checker.cpp
+static bool new_parse(const char *line, bool airport, long &type, int32_t &lat, int32_t &lon)
+{
+    const char *p = line;
+    if (airport) {
+        char *end;
+        type = strtol(line, &end, 10);
+        if (end == line || *end != ',') {
+            return false;
+        }
+        p = end + 1;
+    }
+    if (!parse_ie7(p, lat) || *p++ != ',' || !parse_ie7(p, lon)) {
+        return false;
+    }
+    // the loaders go through double and back
+    lat = dc.floatToiE7(dc.iE7toFloat(lat));
+    lon = dc.floatToiE7(dc.iE7toFloat(lon));
+    return true;
+}
+
+/*
+  a value with exactly 5 past the 7th decimal is a tie. parse_ie7
+  rounds it away from zero, toDouble then lround can go either way
+  depending on the nearest double
+ */
+static bool is_tie(const char *text)
+{
+    const char *dot = strchr(text, '.');
+    if (dot == nullptr || strlen(dot + 1) < 8 || dot[8] != '5') {
+        return false;
+    }
+    for (const char *p = dot + 9; isdigit(*p); p++) {
+        if (*p != '0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the text of field n, for is_tie()
+static String field(const char *line, int n)
+{
+    String s(line);
+    int start = 0;
+    while (n-- > 0) {
+        start = s.indexOf(',', start) + 1;
+    }
+    const int end = s.indexOf(',', start);
+    String ret = end == -1 ? s.substring(start) : s.substring(start, end);
+    ret.trim();
+    return ret;
+}
+
+struct Agreement {
+    uint32_t lines;
+    uint32_t values;
+    uint32_t ties;       // a tie rounded differently, 1e-7 degrees apart
+    uint32_t mismatches;
+};
+
+static bool check_list(const char *path, bool airport, Agreement &agree)
+{
+    File file = SPIFFS.open(path, "r");
+    if (!file) {
+        printf("can't open %s\n", path);
+        return false;
+    }
+    LineReader reader;
+    reader.reset();
+    char line[LINE_READER_BUF_SIZE];
+    while (reader.read_line(file, line, sizeof(line))) {
+        if (line[0] == '#' || line[0] == 0) {
+            continue;
+        }
+        agree.lines++;
+        long old_type = 0, new_type = 0;
+        int32_t old_v[2] {}, new_v[2] {};
+        const bool old_ok = old_parse(String(line), airport, old_type, old_v[0], old_v[1]);
+        const bool new_ok = new_parse(line, airport, new_type, new_v[0], new_v[1]);
+        bool differ = old_ok != new_ok || old_type != new_type;
+        for (uint8_t i=0; i<2 && !differ; i++) {
+            agree.values++;
+            if (old_v[i] == new_v[i]) {
+                continue;
+            }
+            const int32_t diff = old_v[i] - new_v[i];
+            if ((diff == 1 || diff == -1) && is_tie(field(line, i + (airport ? 1 : 0)).c_str())) {
+                agree.ties++;
+                continue;
+            }
+            differ = true;
+        }
+        if (differ) {
+            agree.mismatches++;
+            if (agree.mismatches <= BENCH_MAX_PRINT) {
+                printf("%s: \"%s\" old %ld,%d,%d new %ld,%d,%d\n", path, line,
+                       old_type, int(old_v[0]), int(old_v[1]), new_type, int(new_v[0]), int(new_v[1]));
+            }
+        }
+    }
+    return true;
+}
+
+struct Timing {
+    double ns;
+    uint64_t allocs;
+    uint32_t lines;
+};
+
+// the loaders before, readStringUntil and a String per field
+static void time_old(const char *path, bool airport, Timing &t)
+{
+    HostAllocStats a0, a1;
+    host_get_alloc_stats(a0);
+    const uint64_t t0 = now_ns();
+    File file = SPIFFS.open(path, "r");
+    uint32_t lines = 0;
+    volatile int32_t sink = 0;
+    while (file.available()) {
+        String line = file.readStringUntil('\n');
+        if (line.startsWith("#")) {
+            continue;
+        }
+        long type;
+        int32_t lat, lon;
+        if (old_parse(line, airport, type, lat, lon)) {
+            sink = sink + lat + lon;
+        }
+        lines++;
+    }
+    file.close();
+    const double ns = now_ns() - t0;
+    host_get_alloc_stats(a1);
+    if (t.ns == 0 || ns < t.ns) {
+        t.ns = ns;
+    }
+    t.allocs = a1.count - a0.count;
+    t.lines = lines;
+}
+
+// the loaders now, LineReader and parse_ie7 in place
+static void time_new(const char *path, bool airport, Timing &t)
+{
+    static LineReader reader;
+    HostAllocStats a0, a1;
+    host_get_alloc_stats(a0);
+    const uint64_t t0 = now_ns();
+    File file = SPIFFS.open(path, "r");
+    reader.reset();
+    char line[LINE_READER_BUF_SIZE];
+    uint32_t lines = 0;
+    volatile int32_t sink = 0;
+    while (reader.read_line(file, line, sizeof(line))) {
+        if (line[0] == '#') {
+            continue;
+        }
+        long type;
+        int32_t lat, lon;
+        if (new_parse(line, airport, type, lat, lon)) {
+            sink = sink + lat + lon;
+        }
+        lines++;
+    }
+    file.close();
+    const double ns = now_ns() - t0;
+    host_get_alloc_stats(a1);
+    if (t.ns == 0 || ns < t.ns) {
+        t.ns = ns;
+    }
+    t.allocs = a1.count - a0.count;
+    t.lines = lines;
+}
+
+int main(int argc, char **argv)
+{
+    const char *dir = "../airport_check";
+    uint32_t rounds = BENCH_ROUNDS;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:r:h")) != -1) {
+        switch (opt) {
+        case 'd':
+            dir = optarg;
+            break;
+        case 'r':
+            rounds = strtoul(optarg, nullptr, 0);
+            break;
+        default:
+            printf("usage: bench_parse [-d list_dir] [-r rounds]\n");
+            return 1;
+        }
+    }
+    host_set_spiffs_root(dir);
+
+    const struct {
+        const char *path;
+        bool airport;
+    } lists[] = {
+        { BENCH_AIRPORT_LIST, true },
+        { BENCH_PRISON_LIST, false },
+        { BENCH_COUNTRY_LIST, false },
+    };
+
+    uint32_t failed = check_cases();
+    for (const auto &l : lists) {
+        Agreement agree {};
+        if (!check_list(l.path, l.airport, agree)) {
+            return 1;
+        }
+        printf("%-24s %6u lines, %6u values, %u ties rounded apart, %u mismatches\n",
+               l.path, unsigned(agree.lines), unsigned(agree.values), unsigned(agree.ties), unsigned(agree.mismatches));
+        failed += agree.mismatches;
+    }
+
+    for (const auto &l : lists) {
+        Timing old_t {}, new_t {};
+        for (uint32_t r=0; r<rounds; r++) {
+            time_old(l.path, l.airport, old_t);
+            time_new(l.path, l.airport, new_t);
+        }
+        printf("%-24s String %.1f ms %llu allocs, parse_ie7 %.1f ms %llu allocs, %.0f vs %.0f ns per line\n",
+               l.path, old_t.ns * 1e-6, (unsigned long long)old_t.allocs,
+               new_t.ns * 1e-6, (unsigned long long)new_t.allocs,
+               old_t.ns / old_t.lines, new_t.ns / new_t.lines);
+    }
+
+    if (failed > 0) {
+        printf("FAIL: parse_ie7 disagrees with the old parsing\n");
+        return 1;
+    }
+    return 0;
+}
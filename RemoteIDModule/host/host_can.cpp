@@ -0,0 +1,63 @@
+/*
+  host stand-in for the TWAI CAN driver. Received frames come from the
+  replay, sent frames are counted and dropped
+ */
+
+#include "host_can.h"
+
+static CANFrame rx_queue[HOST_CAN_RX_QUEUE_LEN];
+static uint16_t rx_head;
+static uint16_t rx_count;
+static HostCANStats can_stats;
+
+bool host_can_receive(const CANFrame &frame)
+{
+    if (rx_count == HOST_CAN_RX_QUEUE_LEN) {
+        can_stats.rx_overflow++;
+        return false;
+    }
+    rx_queue[(rx_head + rx_count) % HOST_CAN_RX_QUEUE_LEN] = frame;
+    rx_count++;
+    return true;
+}
+
+void host_get_can_stats(HostCANStats &stats)
+{
+    stats = can_stats;
+}
+
+CANDriver::CANDriver() :
+    bitrate(0),
+    last_bus_recovery_ms(0)
+{
+}
+
+void CANDriver::init(uint32_t _bitrate, uint32_t acceptance_code, uint32_t acceptance_mask)
+{
+    bitrate = _bitrate;
+}
+
+bool CANDriver::send(const CANFrame &frame)
+{
+    if (frame.isErrorFrame() || frame.dlc > 8) {
+        return false;
+    }
+    can_stats.tx_frames++;
+    return true;
+}
+
+uint16_t CANDriver::receive_batch(CANFrame *frames, uint16_t max_frames)
+{
+    uint16_t count = 0;
+    while (count < max_frames && rx_count > 0) {
+        frames[count++] = rx_queue[rx_head];
+        rx_head = (rx_head + 1) % HOST_CAN_RX_QUEUE_LEN;
+        rx_count--;
+    }
+    return count;
+}
+
+uint16_t CANDriver::rx_pending(void) const
+{
+    return rx_count;
+}
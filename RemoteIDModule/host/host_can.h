@@ -0,0 +1,18 @@
+/*
+  host stand-in for the TWAI CAN driver, see host_can.cpp
+ */
+#pragma once
+
+#include <Arduino.h>
+#include "../CANDriver.h"
+
+#define HOST_CAN_RX_QUEUE_LEN 64 // same as the TWAI RX queue
+
+// a frame arriving on the bus, false when the RX queue was full
+bool host_can_receive(const CANFrame &frame);
+
+struct HostCANStats {
+    uint32_t rx_overflow; // frames lost to a full RX queue
+    uint32_t tx_frames;
+};
+void host_get_can_stats(HostCANStats &stats);
@@ -0,0 +1,290 @@
+/*
+  host stand-ins for the Arduino core: clock, UARTs, heap counting
+ */
+
+#include <Arduino.h>
+#include <malloc.h>
+
+HardwareSerial Serial(true);
+HardwareSerial Serial1;
+
+static uint64_t time_us;
+static bool console_enabled = true;
+
+void host_set_time_us(uint64_t t)
+{
+    // the clock never runs backwards, like the hardware timer
+    if (t > time_us) {
+        time_us = t;
+    }
+}
+
+uint64_t host_time_us(void)
+{
+    return time_us;
+}
+
+void host_set_console(bool enable)
+{
+    console_enabled = enable;
+}
+
+uint32_t millis(void)
+{
+    return uint32_t(time_us / 1000U);
+}
+
+uint32_t micros(void)
+{
+    return uint32_t(time_us);
+}
+
+void delay(uint32_t ms)
+{
+    time_us += ms * 1000ULL;
+}
+
+/*
+  fixed seed so a replay gives the same output each run
+ */
+static uint32_t random_state = 0x12345678;
+
+long random(long howbig)
+{
+    if (howbig <= 0) {
+        return 0;
+    }
+    random_state = random_state * 1664525U + 1013904223U;
+    return long(random_state % uint32_t(howbig));
+}
+
+long random(long howsmall, long howbig)
+{
+    if (howsmall >= howbig) {
+        return howsmall;
+    }
+    return howsmall + random(howbig - howsmall);
+}
+
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    const size_t len = strlen(src);
+    if (size > 0) {
+        const size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = 0;
+    }
+    return len;
+}
+
+size_t strlcat(char *dst, const char *src, size_t size)
+{
+    const size_t dlen = strnlen(dst, size);
+    if (dlen == size) {
+        return size + strlen(src);
+    }
+    return dlen + strlcpy(dst + dlen, src, size - dlen);
+}
+#endif
+
+String::String(double v, unsigned decimals)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", int(decimals), v);
+    s = buf;
+}
+
+void String::trim(void)
+{
+    const size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos) {
+        s.clear();
+        return;
+    }
+    const size_t end = s.find_last_not_of(" \t\r\n");
+    s = s.substr(start, end - start + 1);
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+    size_t n = 0;
+    while (n < length) {
+        const int c = read();
+        if (c < 0) {
+            break;
+        }
+        buffer[n++] = char(c);
+    }
+    return n;
+}
+
+String Stream::readStringUntil(char terminator)
+{
+    String ret;
+    while (true) {
+        const int c = read();
+        if (c < 0 || c == terminator) {
+            break;
+        }
+        ret += char(c);
+    }
+    return ret;
+}
+
+size_t Stream::printf(const char *fmt, ...)
+{
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return 0;
+    }
+    if (size_t(n) >= sizeof(buf)) {
+        n = sizeof(buf) - 1;
+    }
+    return write((const uint8_t *)buf, n);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    tx_bytes += size;
+    if (console && console_enabled) {
+        fwrite(buffer, 1, size, stderr);
+    }
+    return size;
+}
+
+int HardwareSerial::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t HardwareSerial::read(uint8_t *buffer, size_t size)
+{
+    const size_t n = std::min(size, rx.size() - rx_ofs);
+    memcpy(buffer, &rx[rx_ofs], n);
+    rx_ofs += n;
+    if (rx_ofs == rx.size()) {
+        rx.clear();
+        rx_ofs = 0;
+    }
+    return n;
+}
+
+void HardwareSerial::host_receive(const uint8_t *buffer, size_t size)
+{
+    rx.insert(rx.end(), buffer, buffer + size);
+    if (rx_cb) {
+        rx_cb();
+    }
+}
+
+/*
+  shutdown handlers run on esp_restart(), the host then carries on
+  with the replay
+ */
+static shutdown_handler_t shutdown_handlers[4];
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler)
+{
+    for (auto &h : shutdown_handlers) {
+        if (h == nullptr) {
+            h = handler;
+            return ESP_OK;
+        }
+    }
+    return ESP_FAIL;
+}
+
+void esp_restart(void)
+{
+    for (auto &h : shutdown_handlers) {
+        if (h != nullptr) {
+            h();
+        }
+    }
+    fprintf(stderr, "esp_restart() at %u ms, not restarting on the host\n", unsigned(millis()));
+}
+
+esp_err_t esp_efuse_mac_get_default(uint8_t *mac)
+{
+    const uint8_t host_mac[6] { 0x02, 0x00, 0x00, 0x12, 0x34, 0x56 };
+    memcpy(mac, host_mac, sizeof(host_mac));
+    return ESP_OK;
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    return esp_efuse_mac_get_default(mac);
+}
+
+/*
+  count every heap allocation, C and C++, by wrapping the glibc
+  allocator
+ */
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+static HostAllocStats alloc_stats;
+
+void host_get_alloc_stats(HostAllocStats &stats)
+{
+    stats = alloc_stats;
+}
+
+extern "C" void *malloc(size_t size)
+{
+    alloc_stats.count++;
+    alloc_stats.bytes += size;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+    alloc_stats.count++;
+    alloc_stats.bytes += n * size;
+    return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    alloc_stats.count++;
+    alloc_stats.bytes += size;
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size)
+{
+    alloc_stats.count++;
+    alloc_stats.bytes += size;
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    void *p = memalign(alignment, size);
+    if (p == nullptr) {
+        return 12; // ENOMEM
+    }
+    *ptr = p;
+    return 0;
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+extern "C" void free(void *ptr)
+{
+    __libc_free(ptr);
+}
@@ -0,0 +1,91 @@
+/*
+  reading recorded MAVLink logs on the host
+ */
+
+#include <Arduino.h>
+#include "../mavlink_msgs.h"
+#include "host_log.h"
+
+bool host_read_file(const char *path, std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr) {
+        fprintf(stderr, "%s: open failed\n", path);
+        return false;
+    }
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(f);
+    return true;
+}
+
+uint16_t host_mavlink_packet_len(const uint8_t *p, size_t avail)
+{
+    if (avail < 3) {
+        return 0;
+    }
+    if (p[0] == MAVLINK_STX) {
+        uint16_t len = MAVLINK_NUM_HEADER_BYTES + p[1] + MAVLINK_NUM_CHECKSUM_BYTES;
+        if (p[2] & MAVLINK_IFLAG_SIGNED) {
+            len += MAVLINK_SIGNATURE_BLOCK_LEN;
+        }
+        return len;
+    }
+    if (p[0] == MAVLINK_STX_MAVLINK1) {
+        return MAVLINK_CORE_HEADER_MAVLINK1_LEN + 1 + p[1] + MAVLINK_NUM_CHECKSUM_BYTES;
+    }
+    return 0;
+}
+
+bool host_is_tlog(const char *path)
+{
+    const size_t n = strlen(path);
+    return n >= 5 && strcmp(path + n - 5, ".tlog") == 0;
+}
+
+/*
+  a .tlog is packets each after a 64 bit big endian timestamp in
+  microseconds since 1970
+ */
+bool host_parse_tlog(const char *path, const std::vector<uint8_t> &data, std::vector<HostTlogPacket> &packets)
+{
+    size_t ofs = 0;
+    while (ofs + 8 < data.size()) {
+        uint64_t t = 0;
+        for (uint8_t i=0; i<8; i++) {
+            t = (t << 8) | data[ofs+i];
+        }
+        ofs += 8;
+        const uint16_t len = host_mavlink_packet_len(&data[ofs], data.size() - ofs);
+        if (len == 0 || ofs + len > data.size()) {
+            fprintf(stderr, "%s: bad packet at offset %u\n", path, unsigned(ofs));
+            return false;
+        }
+        packets.push_back(HostTlogPacket{t, uint32_t(ofs), len});
+        ofs += len;
+    }
+    return true;
+}
+
+bool host_load_mavlink(const char *path, std::vector<uint8_t> &bytes)
+{
+    std::vector<uint8_t> data;
+    if (!host_read_file(path, data)) {
+        return false;
+    }
+    if (!host_is_tlog(path)) {
+        bytes.insert(bytes.end(), data.begin(), data.end());
+        return true;
+    }
+    std::vector<HostTlogPacket> packets;
+    if (!host_parse_tlog(path, data, packets)) {
+        return false;
+    }
+    for (const auto &p : packets) {
+        bytes.insert(bytes.end(), &data[p.ofs], &data[p.ofs + p.len]);
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+/*
+  reading recorded MAVLink logs on the host
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// the whole file, false if it can't be read
+bool host_read_file(const char *path, std::vector<uint8_t> &data);
+
+// length of the MAVLink v1 or v2 packet at p, 0 if it isn't one
+uint16_t host_mavlink_packet_len(const uint8_t *p, size_t avail);
+
+// a .tlog rather than a raw UART capture
+bool host_is_tlog(const char *path);
+
+struct HostTlogPacket {
+    uint64_t time_us; // microseconds since 1970
+    uint32_t ofs;     // into the file data
+    uint16_t len;
+};
+
+// split the data of a .tlog into its packets
+bool host_parse_tlog(const char *path, const std::vector<uint8_t> &data, std::vector<HostTlogPacket> &packets);
+
+// the UART bytes of a .tlog without the timestamps, or of a raw capture
+bool host_load_mavlink(const char *path, std::vector<uint8_t> &bytes);
@@ -0,0 +1,390 @@
+/*
+  host stand-ins for NVS, flash partitions and SPIFFS
+ */
+
+#include <Arduino.h>
+#include <FS.h>
+#include <SPIFFS.h>
+#include <nvs_flash.h>
+#include <esp_partition.h>
+#include <map>
+
+/*
+  NVS, a map of key to type and value. Only the one namespace the
+  parameters use is kept
+ */
+struct NVSEntry {
+    nvs_type_t type;
+    std::vector<uint8_t> value;
+};
+static std::map<std::string, NVSEntry> nvs_entries;
+
+struct nvs_opaque_iterator_t {
+    std::map<std::string, NVSEntry>::const_iterator it;
+    std::string namespace_name;
+    nvs_type_t type;
+};
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    nvs_entries.clear();
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    return nvs_entries.erase(key) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+static esp_err_t nvs_set(const char *key, nvs_type_t type, const void *value, size_t length)
+{
+    NVSEntry &e = nvs_entries[key];
+    e.type = type;
+    e.value.assign((const uint8_t *)value, (const uint8_t *)value + length);
+    return ESP_OK;
+}
+
+static esp_err_t nvs_get(const char *key, nvs_type_t type, void *out_value, size_t *length)
+{
+    const auto it = nvs_entries.find(key);
+    if (it == nvs_entries.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    const NVSEntry &e = it->second;
+    if (e.type != type) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    if (out_value == nullptr) {
+        // length query
+        *length = e.value.size();
+        return ESP_OK;
+    }
+    if (e.value.size() > *length) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, e.value.data(), e.value.size());
+    *length = e.value.size();
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value)
+{
+    size_t len = sizeof(*out_value);
+    return nvs_get(key, NVS_TYPE_U8, out_value, &len);
+}
+
+esp_err_t nvs_get_i8(nvs_handle_t handle, const char *key, int8_t *out_value)
+{
+    size_t len = sizeof(*out_value);
+    return nvs_get(key, NVS_TYPE_I8, out_value, &len);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    size_t len = sizeof(*out_value);
+    return nvs_get(key, NVS_TYPE_U32, out_value, &len);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    return nvs_get(key, NVS_TYPE_STR, out_value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    return nvs_get(key, NVS_TYPE_BLOB, out_value, length);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return nvs_set(key, NVS_TYPE_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_i8(nvs_handle_t handle, const char *key, int8_t value)
+{
+    return nvs_set(key, NVS_TYPE_I8, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return nvs_set(key, NVS_TYPE_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return nvs_set(key, NVS_TYPE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return nvs_set(key, NVS_TYPE_BLOB, value, length);
+}
+
+static nvs_iterator_t nvs_iterator_skip(nvs_iterator_t it)
+{
+    while (it->it != nvs_entries.end() &&
+           it->type != NVS_TYPE_ANY && it->it->second.type != it->type) {
+        ++it->it;
+    }
+    if (it->it == nvs_entries.end()) {
+        delete it;
+        return nullptr;
+    }
+    return it;
+}
+
+nvs_iterator_t nvs_entry_find(const char *part_name, const char *namespace_name, nvs_type_t type)
+{
+    nvs_iterator_t it = new nvs_opaque_iterator_t;
+    it->it = nvs_entries.begin();
+    it->namespace_name = namespace_name;
+    it->type = type;
+    return nvs_iterator_skip(it);
+}
+
+nvs_iterator_t nvs_entry_next(nvs_iterator_t it)
+{
+    ++it->it;
+    return nvs_iterator_skip(it);
+}
+
+void nvs_entry_info(nvs_iterator_t it, nvs_entry_info_t *out_info)
+{
+    memset(out_info, 0, sizeof(*out_info));
+    strlcpy(out_info->namespace_name, it->namespace_name.c_str(), sizeof(out_info->namespace_name));
+    strlcpy(out_info->key, it->it->first.c_str(), sizeof(out_info->key));
+    out_info->type = it->it->second.type;
+}
+
+void nvs_release_iterator(nvs_iterator_t it)
+{
+    delete it;
+}
+
+/*
+  flash partitions held in memory
+ */
+struct HostPartition {
+    esp_partition_t part;
+    std::vector<uint8_t> data;
+};
+static std::vector<HostPartition *> partitions;
+
+bool host_add_partition(const char *label, uint8_t type, uint32_t size, const char *image)
+{
+    HostPartition *p = new HostPartition;
+    memset(&p->part, 0, sizeof(p->part));
+    p->part.type = type;
+    p->part.subtype = ESP_PARTITION_SUBTYPE_ANY;
+    p->part.size = size;
+    strlcpy(p->part.label, label, sizeof(p->part.label));
+    p->data.assign(size, 0xFF);
+    if (image != nullptr) {
+        FILE *f = fopen(image, "rb");
+        if (f == nullptr) {
+            delete p;
+            return false;
+        }
+        fread(p->data.data(), 1, size, f);
+        fclose(f);
+    }
+    partitions.push_back(p);
+    return true;
+}
+
+static HostPartition *find_partition(const esp_partition_t *part)
+{
+    for (auto *p : partitions) {
+        if (&p->part == part) {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    for (auto *p : partitions) {
+        if (p->part.type == type && (label == nullptr || strcmp(p->part.label, label) == 0)) {
+            return &p->part;
+        }
+    }
+    return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t src_offset, void *dst, size_t size)
+{
+    HostPartition *p = find_partition(part);
+    if (p == nullptr || src_offset + size > p->data.size()) {
+        return ESP_FAIL;
+    }
+    memcpy(dst, &p->data[src_offset], size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t dst_offset, const void *src, size_t size)
+{
+    HostPartition *p = find_partition(part);
+    if (p == nullptr || dst_offset + size > p->data.size()) {
+        return ESP_FAIL;
+    }
+    for (size_t i=0; i<size; i++) {
+        p->data[dst_offset+i] &= ((const uint8_t *)src)[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    HostPartition *p = find_partition(part);
+    if (p == nullptr || offset + size > p->data.size() || offset % 4096 != 0 || size % 4096 != 0) {
+        return ESP_FAIL;
+    }
+    memset(&p->data[offset], 0xFF, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *part, size_t offset, size_t size, int memory, const void **out_ptr, spi_flash_mmap_handle_t *out_handle)
+{
+    HostPartition *p = find_partition(part);
+    if (p == nullptr || offset + size > p->data.size()) {
+        return ESP_FAIL;
+    }
+    *out_ptr = &p->data[offset];
+    *out_handle = 0;
+    return ESP_OK;
+}
+
+void spi_flash_munmap(spi_flash_mmap_handle_t handle)
+{
+}
+
+/*
+  SPIFFS files are host files under the root directory
+ */
+fs::SPIFFSFS SPIFFS;
+static std::string spiffs_root = ".";
+
+void host_set_spiffs_root(const char *dir)
+{
+    spiffs_root = dir;
+}
+
+static std::string spiffs_path(const char *path)
+{
+    return spiffs_root + (path[0] == '/' ? "" : "/") + path;
+}
+
+fs::File fs::FS::open(const char *path, const char *mode, const bool create)
+{
+    const std::string mode_b = std::string(mode) + "b";
+    FILE *f = fopen(spiffs_path(path).c_str(), mode_b.c_str());
+    if (f == nullptr) {
+        return File();
+    }
+    return File(f, path);
+}
+
+bool fs::FS::exists(const char *path)
+{
+    FILE *f = fopen(spiffs_path(path).c_str(), "rb");
+    if (f == nullptr) {
+        return false;
+    }
+    fclose(f);
+    return true;
+}
+
+bool fs::FS::remove(const char *path)
+{
+    return ::remove(spiffs_path(path).c_str()) == 0;
+}
+
+fs::File::File(FILE *file, const char *path) :
+    f(file, fclose),
+    path(path)
+{
+    length = size();
+}
+
+size_t fs::File::write(const uint8_t *buffer, size_t size)
+{
+    if (!f) {
+        return 0;
+    }
+    const size_t n = fwrite(buffer, 1, size, f.get());
+    length = std::max(length, position());
+    return n;
+}
+
+int fs::File::available()
+{
+    return f ? int(length - std::min(length, position())) : 0;
+}
+
+int fs::File::read()
+{
+    return f ? fgetc(f.get()) : -1;
+}
+
+size_t fs::File::read(uint8_t *buffer, size_t size)
+{
+    return f ? fread(buffer, 1, size, f.get()) : 0;
+}
+
+int fs::File::peek()
+{
+    if (!f) {
+        return -1;
+    }
+    const int c = fgetc(f.get());
+    if (c != EOF) {
+        ungetc(c, f.get());
+    }
+    return c;
+}
+
+void fs::File::flush()
+{
+    if (f) {
+        fflush(f.get());
+    }
+}
+
+bool fs::File::seek(uint32_t pos)
+{
+    return f && fseek(f.get(), pos, SEEK_SET) == 0;
+}
+
+size_t fs::File::position() const
+{
+    return f ? ftell(f.get()) : 0;
+}
+
+size_t fs::File::size() const
+{
+    if (!f) {
+        return 0;
+    }
+    const long pos = ftell(f.get());
+    fseek(f.get(), 0, SEEK_END);
+    const long end = ftell(f.get());
+    fseek(f.get(), pos, SEEK_SET);
+    return end;
+}
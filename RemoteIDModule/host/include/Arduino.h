@@ -0,0 +1,153 @@
+/*
+  host stand-in for the parts of the Arduino core used by the receive
+  and encode path
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+#include "esp_system.h"
+#include "host.h"
+
+using std::min;
+using std::max;
+
+#define PI 3.1415926535897932384626433832795
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+uint32_t millis(void);
+uint32_t micros(void);
+void delay(uint32_t ms);
+long random(long howbig);
+long random(long howsmall, long howbig);
+
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+// newlib has these, older glibc doesn't
+size_t strlcpy(char *dst, const char *src, size_t size);
+size_t strlcat(char *dst, const char *src, size_t size);
+#endif
+
+/*
+  Arduino String, on the heap like the real one so the allocation
+  counts match
+ */
+class String {
+public:
+    String(const char *s = "") : s(s ? s : "") {}
+    String(const std::string &str) : s(str) {}
+    explicit String(char c) : s(1, c) {}
+    explicit String(int v) : s(std::to_string(v)) {}
+    explicit String(unsigned v) : s(std::to_string(v)) {}
+    explicit String(long v) : s(std::to_string(v)) {}
+    explicit String(unsigned long v) : s(std::to_string(v)) {}
+    explicit String(double v, unsigned decimals = 2);
+
+    unsigned int length(void) const { return s.length(); }
+    const char *c_str(void) const { return s.c_str(); }
+    char operator[](unsigned int i) const { return i < s.length() ? s[i] : 0; }
+
+    String &operator+=(const String &rhs) { s += rhs.s; return *this; }
+    String &operator+=(const char *rhs) { s += rhs; return *this; }
+    String &operator+=(char c) { s += c; return *this; }
+    friend String operator+(const String &a, const String &b) { return String(a.s + b.s); }
+    friend String operator+(const String &a, const char *b) { return String(a.s + b); }
+    friend String operator+(const char *a, const String &b) { return String(a + b.s); }
+    bool operator==(const String &rhs) const { return s == rhs.s; }
+    bool operator==(const char *rhs) const { return s == rhs; }
+    bool operator!=(const String &rhs) const { return s != rhs.s; }
+    bool operator!=(const char *rhs) const { return s != rhs; }
+
+    bool startsWith(const char *prefix) const { return s.compare(0, strlen(prefix), prefix) == 0; }
+    int indexOf(char c, unsigned int from = 0) const
+    {
+        const size_t i = s.find(c, from);
+        return i == std::string::npos ? -1 : int(i);
+    }
+    String substring(unsigned int from) const { return from < s.length() ? String(s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        return from < s.length() && from < to ? String(s.substr(from, to - from)) : String();
+    }
+    long toInt(void) const { return atol(s.c_str()); }
+    float toFloat(void) const { return float(atof(s.c_str())); }
+    double toDouble(void) const { return atof(s.c_str()); }
+    void trim(void);
+
+private:
+    std::string s;
+};
+
+class Stream {
+public:
+    virtual ~Stream() {}
+    virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+    virtual size_t write(uint8_t data) = 0;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() = 0;
+    virtual size_t readBytes(char *buffer, size_t length);
+    String readStringUntil(char terminator);
+    size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+typedef enum {
+    UART_NO_ERROR,
+    UART_BREAK_ERROR,
+    UART_BUFFER_FULL_ERROR,
+    UART_FIFO_OVF_ERROR,
+    UART_FRAME_ERROR,
+    UART_PARITY_ERROR
+} hardwareSerial_error_t;
+
+typedef std::function<void(void)> OnReceiveCb;
+typedef std::function<void(hardwareSerial_error_t)> OnReceiveErrorCb;
+
+#define SERIAL_8N1 0x800001c
+
+/*
+  a UART with the RX side fed by host_receive() and the TX side
+  counted then dropped, or written to stderr for the console
+ */
+class HardwareSerial : public Stream {
+public:
+    HardwareSerial(bool console = false) : console(console) {}
+
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rx_pin = -1, int8_t tx_pin = -1) {}
+    void onReceive(OnReceiveCb cb, bool onlyOnTimeout = false) { rx_cb = cb; }
+    void onReceiveError(OnReceiveErrorCb cb) { rx_error_cb = cb; }
+
+    size_t write(const uint8_t *buffer, size_t size) override;
+    size_t write(uint8_t data) override { return write(&data, 1); }
+    int available() override { return int(rx.size() - rx_ofs); }
+    int availableForWrite() { return 1024; }
+    int read() override;
+    size_t read(uint8_t *buffer, size_t size);
+    int peek() override { return available() ? rx[rx_ofs] : -1; }
+    void flush() override {}
+
+    // bytes arriving on RX, then the onReceive callback as the UART event task would
+    void host_receive(const uint8_t *buffer, size_t size);
+    uint64_t host_tx_bytes(void) const { return tx_bytes; }
+
+private:
+    bool console;
+    std::vector<uint8_t> rx;
+    size_t rx_ofs = 0;
+    uint64_t tx_bytes = 0;
+    OnReceiveCb rx_cb;
+    OnReceiveErrorCb rx_error_cb;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
@@ -0,0 +1,50 @@
+/*
+  host stand-in for the Arduino-ESP32 FS, files under a host directory
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+class File : public Stream {
+public:
+    File() {}
+    File(FILE *f, const char *path);
+
+    size_t write(const uint8_t *buffer, size_t size) override;
+    size_t write(uint8_t data) override { return write(&data, 1); }
+    int available() override;
+    int read() override;
+    size_t read(uint8_t *buffer, size_t size);
+    int peek() override;
+    void flush() override;
+    bool seek(uint32_t pos);
+    size_t position() const;
+    size_t size() const;
+    void close() { f.reset(); }
+    const char *name() const { return path.c_str(); }
+    operator bool() const { return f != nullptr; }
+
+private:
+    std::shared_ptr<FILE> f;
+    std::string path;
+    size_t length = 0; // kept so available() doesn't seek
+};
+
+class FS {
+public:
+    File open(const char *path, const char *mode = FILE_READ, const bool create = false);
+    bool exists(const char *path);
+    bool remove(const char *path);
+};
+
+}
+
+using fs::FS;
+using fs::File;
@@ -0,0 +1,21 @@
+/*
+  host stand-in for SPIFFS, see host_set_spiffs_root()
+ */
+#pragma once
+
+#include "FS.h"
+
+namespace fs {
+
+class SPIFFSFS : public FS {
+public:
+    bool begin(bool formatOnFail = false, const char *basePath = "/spiffs", uint8_t maxOpenFiles = 10, const char *partitionLabel = NULL)
+    {
+        return true;
+    }
+    void end() {}
+};
+
+}
+
+extern fs::SPIFFSFS SPIFFS;
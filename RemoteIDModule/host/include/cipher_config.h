@@ -0,0 +1,10 @@
+/*
+  host placeholder for the private cipher_config.h, only the lengths
+  are used by the code the host build links. A real cipher_config.h
+  next to the firmware sources is picked up first
+ */
+#pragma once
+
+#define MAC_LENGTH 16
+#define NONCE_LENGTH 24
+#define MSG_LENGTH 20
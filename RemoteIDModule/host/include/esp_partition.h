@@ -0,0 +1,31 @@
+/*
+  host stand-in for esp_partition.h, see host_add_partition()
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_system.h"
+
+typedef int esp_partition_type_t;
+typedef int esp_partition_subtype_t;
+typedef uint32_t spi_flash_mmap_handle_t;
+
+#define ESP_PARTITION_SUBTYPE_ANY 0xff
+#define SPI_FLASH_MMAP_DATA 0
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+} esp_partition_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size);
+// like NOR flash, a write can only clear bits
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size, int memory, const void **out_ptr, spi_flash_mmap_handle_t *out_handle);
+void spi_flash_munmap(spi_flash_mmap_handle_t handle);
@@ -0,0 +1,25 @@
+/*
+  host stand-in for esp_system.h
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef enum {
+    ESP_MAC_WIFI_STA,
+    ESP_MAC_WIFI_SOFTAP,
+    ESP_MAC_BT,
+    ESP_MAC_ETH,
+} esp_mac_type_t;
+
+typedef void (*shutdown_handler_t)(void);
+
+// runs the shutdown handlers, then carries on as the host can't reboot
+void esp_restart(void);
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler);
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type);
+esp_err_t esp_efuse_mac_get_default(uint8_t *mac);
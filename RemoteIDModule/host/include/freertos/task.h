@@ -0,0 +1,11 @@
+/*
+  host stand-in for FreeRTOS tasks
+ */
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+
+// nothing waits for a notification on the host
+#define xTaskNotifyGive(task) ((void)(task))
@@ -0,0 +1,30 @@
+/*
+  controls for the host stand-ins, these are not in the firmware
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// virtual clock behind millis() and micros(), set from the log timestamps
+void host_set_time_us(uint64_t time_us);
+uint64_t host_time_us(void);
+
+// heap allocations so far, counted by the malloc wrappers
+struct HostAllocStats {
+    uint64_t count;
+    uint64_t bytes;
+};
+void host_get_alloc_stats(HostAllocStats &stats);
+
+// directory SPIFFS paths are opened under, "." by default
+void host_set_spiffs_root(const char *dir);
+
+/*
+  add a flash partition. It starts erased, or with the contents of
+  image when given. Nothing is written back to the image
+ */
+bool host_add_partition(const char *label, uint8_t type, uint32_t size, const char *image);
+
+// firmware printf on Serial goes to stderr when set
+void host_set_console(bool enable);
@@ -0,0 +1,441 @@
+/*
+  replay recorded MAVLink and DroneCAN streams through the firmware
+  receive, UAS_data and ODID encode code on the host, and report the
+  throughput, time per stage and heap allocations
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include "../options.h"
+#include "../mavlink.h"
+#include "../parameters.h"
+#include "../odid_cache.h"
+#include "../uas_data.h"
+#include "../scheduler.h"
+#include "../util.h"
+#include "host_can.h"
+#include "host_log.h"
+#if AP_DRONECAN_ENABLED
+#include "../DroneCAN.h"
+#endif
+
+#define REPLAY_TRANSPORT_UPDATE_MS 5 // same as TRANSPORT_UPDATE_MS in the firmware
+#define REPLAY_LOOP_MAX_WAIT_MS 100
+#define REPLAY_UART_CHUNK 120 // the UART RX FIFO full threshold
+#define REPLAY_START_US 1000000ULL // the log starts 1s after boot
+#define REPLAY_MAX_FILES 8
+
+static MAVLinkSerial mavlink{Serial1, MAVLINK_COMM_0};
+#if AP_DRONECAN_ENABLED
+static DroneCAN dronecan;
+#endif
+static ODIDCache odid_cache;
+static Scheduler scheduler;
+static int8_t transport_slot;
+ODID_UAS_Data UAS_data;
+
+/*
+  one MAVLink chunk or CAN frame, at a time relative to the start of
+  the logs
+ */
+struct Event {
+    uint64_t time_us;
+    uint32_t ofs; // MAVLink bytes in the mavlink_data buffer
+    uint16_t len;
+    bool can;
+    CANFrame frame;
+};
+static std::vector<Event> events;
+static std::vector<uint8_t> mavlink_data;
+
+enum Stage {
+    STAGE_PARSE,  // transport update(), framing and decoding
+    STAGE_BUILD,  // uas_data_update()
+    STAGE_ENCODE, // ODIDCache::update(), messages and pack
+    STAGE_STATUS, // Transport::status_check()
+    STAGE_COUNT
+};
+static const char *stage_names[STAGE_COUNT] { "parse", "build", "encode", "status" };
+
+static struct {
+    std::vector<uint32_t> ns;
+    uint64_t allocs;
+    uint64_t alloc_bytes;
+} stages[STAGE_COUNT];
+
+static struct {
+    uint64_t mavlink_bytes;
+    uint32_t can_frames;
+    uint32_t cycles;
+    uint32_t packs;
+    uint16_t pack_length;
+    uint8_t bad;
+} totals;
+
+static uint64_t now_ns(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+  time one stage and count the heap allocations made inside it
+ */
+template <typename F>
+static void run_stage(Stage s, F fn)
+{
+    HostAllocStats a0, a1;
+    host_get_alloc_stats(a0);
+    const uint64_t t0 = now_ns();
+    fn();
+    const uint64_t t1 = now_ns();
+    host_get_alloc_stats(a1);
+    stages[s].ns.push_back(uint32_t(t1 - t0));
+    stages[s].allocs += a1.count - a0.count;
+    stages[s].alloc_bytes += a1.bytes - a0.bytes;
+}
+
+/*
+  the parts of update_transports() and set_data() in the firmware that
+  don't touch the radios, display or LEDs
+ */
+static void update_transports(uint32_t now_ms)
+{
+    totals.cycles++;
+    run_stage(STAGE_PARSE, []() {
+        mavlink.update();
+#if AP_DRONECAN_ENABLED
+        dronecan.update();
+#endif
+    });
+
+    if (!g.bcast_powerup && mavlink.get_last_location_ms() == 0) {
+        // no broadcast until the first location
+        return;
+    }
+
+    uint8_t changed = 0;
+    bool flt_time_changed;
+    run_stage(STAGE_BUILD, [&]() {
+        changed = uas_data_update(mavlink, UAS_data, flt_time_changed);
+    });
+
+    const uint32_t pack_generation = odid_cache.get_pack_generation();
+    run_stage(STAGE_ENCODE, [&]() {
+        totals.bad = odid_cache.update(UAS_data, changed);
+    });
+    if (odid_cache.get_pack_generation() != pack_generation) {
+        totals.packs++;
+        odid_cache.get_pack(totals.pack_length);
+    }
+
+    const char *reason = totals.bad != 0 ? "bad ODID data" : nullptr;
+    run_stage(STAGE_STATUS, [&]() {
+        mavlink.status_check(reason);
+    });
+    mavlink.set_parse_fail(reason);
+}
+
+static void flush_params(uint32_t now_ms)
+{
+    g.flush();
+}
+
+/*
+  the packets of a .tlog, at their logged times
+ */
+static bool load_tlog(const char *path, std::vector<Event> &out)
+{
+    std::vector<uint8_t> data;
+    std::vector<HostTlogPacket> packets;
+    if (!host_read_file(path, data) || !host_parse_tlog(path, data, packets)) {
+        return false;
+    }
+    for (const auto &p : packets) {
+        Event e {};
+        e.time_us = p.time_us;
+        e.ofs = mavlink_data.size();
+        e.len = p.len;
+        mavlink_data.insert(mavlink_data.end(), &data[p.ofs], &data[p.ofs + p.len]);
+        out.push_back(e);
+    }
+    return true;
+}
+
+/*
+  a raw capture of the UART, given times from the baud rate
+ */
+static bool load_raw(const char *path, uint32_t baudrate, std::vector<Event> &out)
+{
+    std::vector<uint8_t> data;
+    if (!host_read_file(path, data)) {
+        return false;
+    }
+    const double us_per_byte = 10 * 1.0e6 / baudrate;
+    for (size_t ofs=0; ofs<data.size(); ofs += REPLAY_UART_CHUNK) {
+        Event e {};
+        e.len = std::min(size_t(REPLAY_UART_CHUNK), data.size() - ofs);
+        e.time_us = uint64_t((ofs + e.len) * us_per_byte);
+        e.ofs = mavlink_data.size();
+        mavlink_data.insert(mavlink_data.end(), &data[ofs], &data[ofs+e.len]);
+        out.push_back(e);
+    }
+    return true;
+}
+
+/*
+  candump -l log, lines like "(1690000000.123456) can0 18EA1234#0102030405"
+ */
+static bool load_candump(const char *path, std::vector<Event> &out)
+{
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) {
+        fprintf(stderr, "%s: open failed\n", path);
+        return false;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long sec, usec;
+        char id_hex[16];
+        char data_hex[40] {};
+        if (sscanf(line, " (%lu.%lu) %*s %15[0-9A-Fa-f]#%39s", &sec, &usec, id_hex, data_hex) != 4 &&
+            sscanf(line, " (%lu.%lu) %*s %15[0-9A-Fa-f]#", &sec, &usec, id_hex) != 3) {
+            continue;
+        }
+        if (strlen(data_hex) > 16 || data_hex[0] == 'R') {
+            // CAN FD or remote frame
+            continue;
+        }
+        Event e {};
+        e.can = true;
+        e.time_us = sec * 1000000ULL + usec;
+        e.frame.id = strtoul(id_hex, nullptr, 16);
+        if (strlen(id_hex) > 3) {
+            e.frame.id |= CANFrame::FlagEFF;
+        }
+        const uint8_t n = strlen(data_hex) / 2;
+        for (uint8_t i=0; i<n; i++) {
+            char byte_hex[3] { data_hex[2*i], data_hex[2*i+1], 0 };
+            e.frame.data[i] = strtoul(byte_hex, nullptr, 16);
+        }
+        e.frame.dlc = n;
+        out.push_back(e);
+    }
+    fclose(f);
+    return true;
+}
+
+/*
+  run the scheduler until the next event is due
+ */
+static void run_until(uint64_t time_us)
+{
+    while (true) {
+        const uint32_t wait_ms = scheduler.run(millis(), REPLAY_LOOP_MAX_WAIT_MS);
+        const uint64_t next_us = host_time_us() + std::max(wait_ms, 1U) * 1000ULL;
+        if (next_us > time_us) {
+            break;
+        }
+        host_set_time_us(next_us);
+    }
+    host_set_time_us(time_us);
+}
+
+static void replay(uint64_t start_us)
+{
+    for (const Event &e : events) {
+        run_until(start_us + e.time_us);
+        if (e.can) {
+            totals.can_frames++;
+            host_can_receive(e.frame);
+            continue;
+        }
+        totals.mavlink_bytes += e.len;
+        Serial1.host_receive(&mavlink_data[e.ofs], e.len);
+        // MAVLink data wakes the main loop
+        scheduler.trigger(transport_slot, millis());
+        scheduler.run(millis(), REPLAY_LOOP_MAX_WAIT_MS);
+    }
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+}
+
+static void report(uint64_t log_us)
+{
+    uint64_t total_ns = 0;
+    printf("%-8s %9s %9s %9s %9s %9s %9s %11s\n",
+           "stage", "calls", "mean_us", "p50_us", "p99_us", "max_us", "allocs", "alloc_bytes");
+    for (uint8_t s=0; s<STAGE_COUNT; s++) {
+        std::vector<uint32_t> ns = stages[s].ns;
+        std::sort(ns.begin(), ns.end());
+        uint64_t sum = 0;
+        for (const uint32_t v : ns) {
+            sum += v;
+        }
+        total_ns += sum;
+        printf("%-8s %9u %9.2f %9.2f %9.2f %9.2f %9llu %11llu\n",
+               stage_names[s], unsigned(ns.size()),
+               ns.empty() ? 0 : sum * 1.0e-3 / ns.size(),
+               percentile(ns, 0.5) * 1.0e-3, percentile(ns, 0.99) * 1.0e-3,
+               ns.empty() ? 0 : ns.back() * 1.0e-3,
+               (unsigned long long)stages[s].allocs, (unsigned long long)stages[s].alloc_bytes);
+    }
+
+    const double cpu_s = total_ns * 1.0e-9;
+    printf("\nlog %.1f s, %llu MAVLink bytes, %u CAN frames, %u update cycles\n",
+           log_us * 1.0e-6, (unsigned long long)totals.mavlink_bytes, unsigned(totals.can_frames), unsigned(totals.cycles));
+    printf("cpu %.3f ms in the stages, %.0fx real time, %.2f MB/s MAVLink, %.0f CAN frames/s\n",
+           cpu_s * 1.0e3, cpu_s > 0 ? log_us * 1.0e-6 / cpu_s : 0,
+           cpu_s > 0 ? totals.mavlink_bytes / cpu_s * 1.0e-6 : 0,
+           cpu_s > 0 ? totals.can_frames / cpu_s : 0);
+
+    MAVLinkSerial::RxStats mav;
+    MAVLinkSerial::get_rx_stats(mav);
+    printf("MAVLink rx: frames %u skipped %u crc_errors %u ring_overflow %u\n",
+           unsigned(mav.frames), unsigned(mav.skipped), unsigned(mav.crc_errors), unsigned(mav.ring_overflow));
+#if AP_DRONECAN_ENABLED
+    DroneCAN::RxStats can;
+    dronecan.get_rx_stats(can);
+    HostCANStats host_can;
+    host_get_can_stats(host_can);
+    printf("DroneCAN rx: frames %u dropped %u backlog_max %u queue_overflow %u, tx frames %u\n",
+           unsigned(can.frames), unsigned(can.dropped), unsigned(can.backlog_max),
+           unsigned(host_can.rx_overflow), unsigned(host_can.tx_frames));
+#endif
+    printf("ODID: %u packs built, last %u bytes, bad 0x%02x\n",
+           unsigned(totals.packs), unsigned(totals.pack_length), unsigned(totals.bad));
+}
+
+static void usage(void)
+{
+    printf("usage: replay [-v] [-b baud] [-n repeat] [-p NAME=VALUE]... [-m file]... [-c file]...\n"
+           "  -m FILE  MAVLink, a .tlog or else a raw UART capture\n"
+           "  -c FILE  DroneCAN, a candump -l log\n"
+           "  -b BAUD  UART rate for the times of a raw capture (default 921600)\n"
+           "  -n N     replay the logs N times\n"
+           "  -p N=V   set a parameter before the replay\n"
+           "  -v       show the firmware console output\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *mavlink_files[REPLAY_MAX_FILES];
+    const char *can_files[REPLAY_MAX_FILES];
+    const char *param_sets[REPLAY_MAX_FILES * 4];
+    uint8_t num_mavlink = 0, num_can = 0, num_params = 0;
+    uint32_t baudrate = 921600;
+    uint32_t repeat = 1;
+    bool verbose = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:c:b:n:p:vh")) != -1) {
+        switch (opt) {
+        case 'm':
+            if (num_mavlink < REPLAY_MAX_FILES) {
+                mavlink_files[num_mavlink++] = optarg;
+            }
+            break;
+        case 'c':
+            if (num_can < REPLAY_MAX_FILES) {
+                can_files[num_can++] = optarg;
+            }
+            break;
+        case 'b':
+            baudrate = strtoul(optarg, nullptr, 0);
+            break;
+        case 'n':
+            repeat = strtoul(optarg, nullptr, 0);
+            break;
+        case 'p':
+            if (num_params < ARRAY_SIZE(param_sets)) {
+                param_sets[num_params++] = optarg;
+            }
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+    if (num_mavlink + num_can == 0 || baudrate == 0) {
+        usage();
+        return 1;
+    }
+
+    /*
+      logs with timestamps are lined up on their own clock, raw
+      captures start with the first of them
+     */
+    uint64_t first_us = UINT64_MAX;
+    std::vector<Event> raw;
+    for (uint8_t i=0; i<num_mavlink; i++) {
+        const bool ok = host_is_tlog(mavlink_files[i]) ?
+            load_tlog(mavlink_files[i], events) : load_raw(mavlink_files[i], baudrate, raw);
+        if (!ok) {
+            return 1;
+        }
+    }
+    for (uint8_t i=0; i<num_can; i++) {
+        if (!load_candump(can_files[i], events)) {
+            return 1;
+        }
+    }
+    for (const Event &e : events) {
+        first_us = std::min(first_us, e.time_us);
+    }
+    for (Event &e : events) {
+        e.time_us -= first_us;
+    }
+    events.insert(events.end(), raw.begin(), raw.end());
+    std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) {
+        return a.time_us < b.time_us;
+    });
+    if (events.empty()) {
+        fprintf(stderr, "nothing to replay\n");
+        return 1;
+    }
+    const uint64_t log_us = events.back().time_us + 1000;
+
+    host_set_console(verbose);
+    g.init();
+    for (uint8_t i=0; i<num_params; i++) {
+        char name[PARAM_NAME_MAX_LEN+1] {};
+        const char *eq = strchr(param_sets[i], '=');
+        if (eq == nullptr || eq - param_sets[i] > PARAM_NAME_MAX_LEN) {
+            fprintf(stderr, "bad parameter %s\n", param_sets[i]);
+            return 1;
+        }
+        memcpy(name, param_sets[i], eq - param_sets[i]);
+        if (!g.set_by_name_string(name, eq+1)) {
+            fprintf(stderr, "failed to set %s\n", param_sets[i]);
+            return 1;
+        }
+    }
+    odid_initUasData(&UAS_data);
+    mavlink.init();
+#if AP_DRONECAN_ENABLED
+    dronecan.init();
+#endif
+    transport_slot = scheduler.add(update_transports, REPLAY_TRANSPORT_UPDATE_MS, millis());
+    scheduler.add(flush_params, PARAM_FLUSH_MS, millis());
+    for (auto &s : stages) {
+        s.ns.reserve(events.size() * repeat + log_us * repeat / (REPLAY_TRANSPORT_UPDATE_MS * 1000) + 16);
+    }
+
+    for (uint32_t i=0; i<repeat; i++) {
+        replay(REPLAY_START_US + i * log_us);
+    }
+    run_until(REPLAY_START_US + repeat * log_us);
+    report(repeat * log_us);
+    return 0;
+}
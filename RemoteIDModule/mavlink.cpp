@@ -10,6 +10,9 @@
 #define SERIAL_BAUD 115200
 
 static HardwareSerial *serial_ports[MAVLINK_COMM_NUM_BUFFERS];
+static MAVLinkSerial *mavlink_ports[MAVLINK_COMM_NUM_BUFFERS];
+
+bool MAVLinkSerial::rx_skip_unwanted = true;
 
 #include <generated/mavlink_helpers.h>
 
@@ -35,6 +38,7 @@ MAVLinkSerial::MAVLinkSerial(HardwareSerial &_serial, mavlink_channel_t _chan) :
     chan(_chan)
 {
     serial_ports[uint8_t(_chan - MAVLINK_COMM_0)] = &serial;
+    mavlink_ports[uint8_t(_chan - MAVLINK_COMM_0)] = this;
 }
 
 void MAVLinkSerial::init(void)
@@ -43,6 +47,15 @@ void MAVLinkSerial::init(void)
     serial.printf("ArduRemoteID version %u.%u %08x\n",
                   FW_VERSION_MAJOR, FW_VERSION_MINOR, GIT_VERSION);
     mavlink_system.sysid = g.mavlink_sysid;
+    // bytes are moved to our ring on the UART event task, which then
+    // wakes the main loop
+    serial.onReceive([this]() { rx_fill(); });
+    serial.onReceiveError([this](hardwareSerial_error_t err) {
+        if (err == UART_FIFO_OVF_ERROR || err == UART_BUFFER_FULL_ERROR) {
+            rx_stats.uart_overflow++;
+        }
+        rx_fill();
+    });
 }
 
 void MAVLinkSerial::update(void)
@@ -58,22 +71,31 @@ void MAVLinkSerial::update(void)
         serial.printf("Waiting for heartbeat\n");
     }
     update_receive();
+    update_param_stream();
+}
 
-    if (param_request_last_ms != 0 && now_ms - param_request_last_ms > 50) {
-        param_request_last_ms = now_ms;
+/*
+  send the parameter list for PARAM_REQUEST_LIST as fast as the UART
+  takes it, carrying on next update() when the TX buffer is full
+ */
+void MAVLinkSerial::update_param_stream(void)
+{
+    const int frame_len = MAVLINK_MSG_ID_PARAM_VALUE_LEN + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+    while (param_streaming && serial.availableForWrite() >= frame_len) {
+        const Parameters::Param *p = g.find_by_index_float(param_stream_index);
+        if (p == nullptr) {
+            param_streaming = false;
+            break;
+        }
         float value;
-        if (param_next->get_as_float(value)) {
+        if (p->get_as_float(value)) {
             mavlink_msg_param_value_send(chan,
-                                         param_next->name, value,
+                                         p->name, value,
                                          MAV_PARAM_TYPE_REAL32,
                                          g.param_count_float(),
-                                         g.param_index_float(param_next));
-        }
-        param_next++;
-        if (param_next->ptype == Parameters::ParamType::NONE) {
-            param_next = nullptr;
-            param_request_last_ms = 0;
+                                         param_stream_index);
         }
+        param_stream_index++;
     }
 }
 
@@ -95,20 +117,176 @@ void MAVLinkSerial::update_send(void)
     }
 }
 
+/*
+  move what the UART driver has into our ring. Runs on the UART event
+  task, so a stall in loop() costs ring space rather than bytes lost in
+  the UART FIFO
+ */
+void MAVLinkSerial::rx_fill(void)
+{
+    while (true) {
+        const size_t avail = serial.available();
+        if (avail == 0) {
+            break;
+        }
+        const uint16_t head = rx_head;
+        const uint16_t space = MAVLINK_RX_RING_SIZE - uint16_t(head - rx_tail);
+        if (space == 0) {
+            // update() has fallen behind, drop the new bytes
+            uint8_t discard[64];
+            rx_stats.ring_overflow += serial.read(discard, avail < sizeof(discard) ? avail : sizeof(discard));
+            continue;
+        }
+        const uint16_t ofs = head & (MAVLINK_RX_RING_SIZE-1);
+        size_t n = avail < space ? avail : space;
+        if (n > size_t(MAVLINK_RX_RING_SIZE - ofs)) {
+            n = MAVLINK_RX_RING_SIZE - ofs;
+        }
+        n = serial.read(&rx_ring[ofs], n);
+        __sync_synchronize();
+        rx_head = head + n;
+    }
+    notify_rx();
+}
+
+/*
+  the messages process_packet() handles, others are framed and skipped
+ */
+static bool msgid_wanted(uint32_t msgid)
+{
+    switch (msgid) {
+    case MAVLINK_MSG_ID_HEARTBEAT:
+    case MAVLINK_MSG_ID_OPEN_DRONE_ID_LOCATION:
+    case MAVLINK_MSG_ID_OPEN_DRONE_ID_BASIC_ID:
+    case MAVLINK_MSG_ID_OPEN_DRONE_ID_AUTHENTICATION:
+    case MAVLINK_MSG_ID_OPEN_DRONE_ID_SELF_ID:
+    case MAVLINK_MSG_ID_OPEN_DRONE_ID_SYSTEM:
+    case MAVLINK_MSG_ID_OPEN_DRONE_ID_SYSTEM_UPDATE:
+    case MAVLINK_MSG_ID_OPEN_DRONE_ID_OPERATOR_ID:
+    case MAVLINK_MSG_ID_PARAM_REQUEST_LIST:
+    case MAVLINK_MSG_ID_PARAM_REQUEST_READ:
+    case MAVLINK_MSG_ID_PARAM_SET:
+    case MAVLINK_MSG_ID_SECURE_COMMAND:
+    case MAVLINK_MSG_ID_SECURE_COMMAND_REPLY:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+  frame the MAVLink v1 or v2 packet at the ring tail in place, only
+  CRC checking and copying it out if we handle it. Returns false when
+  more bytes are needed
+ */
+bool MAVLinkSerial::rx_frame(void)
+{
+    const uint16_t avail = uint16_t(rx_head - rx_tail);
+    if (avail == 0) {
+        return false;
+    }
+    const uint8_t stx = rx_peek(0);
+    const bool v2 = stx == MAVLINK_STX;
+    if (!v2 && stx != MAVLINK_STX_MAVLINK1) {
+        rx_tail++;
+        return true;
+    }
+    const uint8_t header_len = v2 ? MAVLINK_NUM_HEADER_BYTES : MAVLINK_CORE_HEADER_MAVLINK1_LEN+1;
+    if (avail < header_len) {
+        return false;
+    }
+    const uint8_t len = rx_peek(1);
+    const uint8_t incompat_flags = v2 ? rx_peek(2) : 0;
+    uint16_t frame_len = header_len + len + MAVLINK_NUM_CHECKSUM_BYTES;
+    if (incompat_flags & MAVLINK_IFLAG_SIGNED) {
+        frame_len += MAVLINK_SIGNATURE_BLOCK_LEN;
+    }
+    if (avail < frame_len) {
+        return false;
+    }
+    const uint32_t msgid = v2 ? (rx_peek(7) | (rx_peek(8)<<8) | (uint32_t(rx_peek(9))<<16)) : rx_peek(5);
+
+    const bool wanted = msgid_wanted(msgid);
+    if (!wanted && rx_skip_unwanted) {
+        /*
+          most of a busy autopilot link is attitude/IMU streams we
+          don't handle. Skip those without the CRC as long as the next
+          packet starts where this one ends, which catches nearly all
+          false start bytes
+         */
+        if (avail == frame_len) {
+            return false;
+        }
+        const uint8_t next = rx_peek(frame_len);
+        if (next == MAVLINK_STX || next == MAVLINK_STX_MAVLINK1) {
+            rx_stats.skipped++;
+            rx_tail += frame_len;
+            return true;
+        }
+    }
+
+    const mavlink_msg_entry_t *entry = mavlink_get_msg_entry(msgid);
+    if (entry == nullptr) {
+        // not in our dialect so we can't check it, and don't want it
+        rx_tail += frame_len;
+        return true;
+    }
+    uint16_t crc;
+    crc_init(&crc);
+    for (uint16_t i=1; i<header_len+len; i++) {
+        crc_accumulate(rx_peek(i), &crc);
+    }
+    crc_accumulate(entry->crc_extra, &crc);
+    const uint16_t ck = rx_peek(header_len+len) | (rx_peek(header_len+len+1)<<8);
+    if (crc != ck || (incompat_flags & ~MAVLINK_IFLAG_SIGNED)) {
+        // a false start byte or a corrupt packet, resync on the next byte
+        rx_stats.crc_errors++;
+        rx_tail++;
+        return true;
+    }
+
+    if (wanted) {
+        mavlink_message_t msg;
+        msg.magic = stx;
+        msg.len = len;
+        msg.incompat_flags = incompat_flags;
+        msg.compat_flags = v2 ? rx_peek(3) : 0;
+        msg.seq = rx_peek(v2 ? 4 : 2);
+        msg.sysid = rx_peek(v2 ? 5 : 3);
+        msg.compid = rx_peek(v2 ? 6 : 4);
+        msg.msgid = msgid;
+        msg.checksum = ck;
+        uint8_t *payload = (uint8_t *)msg.payload64;
+        for (uint8_t i=0; i<len; i++) {
+            payload[i] = rx_peek(header_len+i);
+        }
+        // v2 trims trailing zeros from the payload
+        memset(&payload[len], 0, MAVLINK_MAX_PAYLOAD_LEN - len);
+        rx_stats.frames++;
+        process_packet(msg);
+    }
+    rx_tail += frame_len;
+    return true;
+}
+
 void MAVLinkSerial::update_receive(void)
 {
-    // receive new packets
-    mavlink_message_t msg;
-    mavlink_status_t status;
-    status.packet_rx_drop_count = 0;
+    while (rx_frame()) {
+    }
+}
 
-    const uint16_t nbytes = serial.available();
-    for (uint16_t i=0; i<nbytes; i++) {
-        const uint8_t c = (uint8_t)serial.read();
-        // Try to get a new message
-        if (mavlink_parse_char(chan, c, &msg, &status)) {
-            process_packet(status, msg);
+void MAVLinkSerial::get_rx_stats(RxStats &stats)
+{
+    memset(&stats, 0, sizeof(stats));
+    for (const auto *port : mavlink_ports) {
+        if (port == nullptr) {
+            continue;
         }
+        stats.frames += port->rx_stats.frames;
+        stats.skipped += port->rx_stats.skipped;
+        stats.crc_errors += port->rx_stats.crc_errors;
+        stats.ring_overflow += port->rx_stats.ring_overflow;
+        stats.uart_overflow += port->rx_stats.uart_overflow;
     }
 }
 
@@ -128,7 +306,7 @@ void MAVLinkSerial::mav_printf(uint8_t severity, const char *fmt, ...)
                                 0, 0);
 }
 
-void MAVLinkSerial::process_packet(mavlink_status_t &status, mavlink_message_t &msg)
+void MAVLinkSerial::process_packet(mavlink_message_t &msg)
 {
     const uint32_t now_ms = millis();
     switch (msg.msgid) {
@@ -153,6 +331,7 @@ void MAVLinkSerial::process_packet(mavlink_status_t &status, mavlink_message_t &
             last_location_timestamp = location.timestamp;
         }
         last_location_ms = now_ms;
+        mark_updated(MsgType::LOCATION);
         break;
     }
     case MAVLINK_MSG_ID_OPEN_DRONE_ID_BASIC_ID: {
@@ -165,6 +344,7 @@ void MAVLinkSerial::process_packet(mavlink_status_t &status, mavlink_message_t &
             //only update if we receive valid data
             basic_id = basic_id_tmp;
             last_basic_id_ms = now_ms;
+            mark_updated(MsgType::BASIC_ID);
         }
         break;
     }
@@ -173,6 +353,7 @@ void MAVLinkSerial::process_packet(mavlink_status_t &status, mavlink_message_t &
         if (g.options & OPTIONS_PRINT_RID_MAVLINK) {
             Serial.printf("MAVLink: got Auth\n");
         }
+        mark_updated(MsgType::AUTHENTICATION);
         break;
     }
     case MAVLINK_MSG_ID_OPEN_DRONE_ID_SELF_ID: {
@@ -181,6 +362,7 @@ void MAVLinkSerial::process_packet(mavlink_status_t &status, mavlink_message_t &
             Serial.printf("MAVLink: got SelfID\n");
         }
         last_self_id_ms = now_ms;
+        mark_updated(MsgType::SELF_ID);
         break;
     }
     case MAVLINK_MSG_ID_OPEN_DRONE_ID_SYSTEM: {
@@ -193,6 +375,7 @@ void MAVLinkSerial::process_packet(mavlink_status_t &status, mavlink_message_t &
             last_system_ms = millis();
             last_system_timestamp = system.timestamp;
         }
+        mark_updated(MsgType::SYSTEM);
         break;
     }
     case MAVLINK_MSG_ID_OPEN_DRONE_ID_SYSTEM_UPDATE: {
@@ -215,6 +398,7 @@ void MAVLinkSerial::process_packet(mavlink_status_t &status, mavlink_message_t &
             }
             last_system_ms = now_ms;
         }
+        mark_updated(MsgType::SYSTEM);
         break;
     }
     case MAVLINK_MSG_ID_OPEN_DRONE_ID_OPERATOR_ID: {
@@ -223,11 +407,12 @@ void MAVLinkSerial::process_packet(mavlink_status_t &status, mavlink_message_t &
             Serial.printf("MAVLink: got OperatorID\n");
         }
         last_operator_id_ms = now_ms;
+        mark_updated(MsgType::OPERATOR_ID);
         break;
     }
     case MAVLINK_MSG_ID_PARAM_REQUEST_LIST: {
-        param_next = g.find_by_index_float(0);
-        param_request_last_ms = millis();
+        param_stream_index = 0;
+        param_streaming = true;
         break;
     };
     case MAVLINK_MSG_ID_PARAM_REQUEST_READ: {
@@ -5,6 +5,8 @@
 #include "transport.h"
 #include "parameters.h"
 
+#define MAVLINK_RX_RING_SIZE 2048 // power of 2, several bursts at 921600 baud
+
 /*
   abstraction for MAVLink on a serial port
  */
@@ -15,17 +17,51 @@ public:
     void init(void) override;
     void update(void) override;
 
+    struct RxStats {
+        uint32_t frames;        // packets we handle
+        uint32_t skipped;       // packets we don't handle, not CRC checked
+        uint32_t crc_errors;    // bad frames, skipped a byte at a time
+        uint32_t ring_overflow; // bytes dropped because update() fell behind
+        uint32_t uart_overflow; // UART FIFO or driver buffer overflows
+    };
+
+    // receive counters summed over all MAVLink ports
+    static void get_rx_stats(RxStats &stats);
+
+    // CRC check the packets we don't handle too, for comparing framing costs
+    static void set_rx_skip_unwanted(bool enable)
+    {
+        rx_skip_unwanted = enable;
+    }
+
 private:
+    static bool rx_skip_unwanted;
     HardwareSerial &serial;
     mavlink_channel_t chan;
     uint32_t last_hb_ms;
     uint32_t last_hb_warn_ms;
-    uint32_t param_request_last_ms;
-    const Parameters::Param *param_next;
+    // PARAM_REQUEST_LIST in progress
+    bool param_streaming;
+    uint16_t param_stream_index;
+
+    /*
+      bytes from the UART event task, framed in place by update()
+     */
+    uint8_t rx_ring[MAVLINK_RX_RING_SIZE];
+    volatile uint16_t rx_head; // written by the UART event task
+    volatile uint16_t rx_tail; // written by update()
+    RxStats rx_stats;
 
+    uint8_t rx_peek(uint16_t ofs) const
+    {
+        return rx_ring[uint16_t(rx_tail + ofs) & (MAVLINK_RX_RING_SIZE-1)];
+    }
+    void rx_fill(void);
+    bool rx_frame(void);
     void update_receive(void);
     void update_send(void);
-    void process_packet(mavlink_status_t &status, mavlink_message_t &msg);
+    void update_param_stream(void);
+    void process_packet(mavlink_message_t &msg);
     void mav_printf(uint8_t severity, const char *fmt, ...);
     void handle_secure_command(const mavlink_secure_command_t &pkt);
 
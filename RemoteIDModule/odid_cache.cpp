@@ -0,0 +1,141 @@
+/*
+  encoded OpenDroneID messages shared by the transmitters
+ */
+
+#include "odid_cache.h"
+#include "util.h"
+
+uint8_t ODIDCache::update(const ODID_UAS_Data &UAS_data, uint8_t changed)
+{
+    /*
+      the encode functions take non-const pointers but don't change
+      the input
+     */
+    ODID_UAS_Data &data = const_cast<ODID_UAS_Data &>(UAS_data);
+
+    if (changed & UAS_PART_LOCATION) {
+        memset(&location, 0, sizeof(location));
+        bad &= ~ODID_BAD_LOCATION;
+        if (encodeLocationMessage(&location, &data.Location) != ODID_SUCCESS) {
+            bad |= ODID_BAD_LOCATION;
+        }
+    }
+    if (changed & UAS_PART_SYSTEM) {
+        memset(&system, 0, sizeof(system));
+        bad &= ~ODID_BAD_SYSTEM;
+        if (encodeSystemMessage(&system, &data.System) != ODID_SUCCESS) {
+            bad |= ODID_BAD_SYSTEM;
+        }
+    }
+    if (changed & UAS_PART_BASIC_ID) {
+        const uint8_t bad_bit[ODID_BASIC_ID_MAX_MESSAGES] { ODID_BAD_BASIC_ID_1, ODID_BAD_BASIC_ID_2 };
+        for (uint8_t i=0; i<ODID_BASIC_ID_MAX_MESSAGES; i++) {
+            memset(&basic_id[i], 0, sizeof(basic_id[i]));
+            bad &= ~bad_bit[i];
+            // an unset BasicID is not an error
+            if (UAS_data.BasicIDValid[i] == 1 &&
+                encodeBasicIDMessage(&basic_id[i], &data.BasicID[i]) != ODID_SUCCESS) {
+                bad |= bad_bit[i];
+            }
+        }
+    }
+    if (changed & UAS_PART_SELF_ID) {
+        memset(&self_id, 0, sizeof(self_id));
+        bad &= ~ODID_BAD_SELF_ID;
+        if (encodeSelfIDMessage(&self_id, &data.SelfID) != ODID_SUCCESS) {
+            bad |= ODID_BAD_SELF_ID;
+        }
+    }
+    if (changed & UAS_PART_OPERATOR_ID) {
+        memset(&operator_id, 0, sizeof(operator_id));
+        bad &= ~ODID_BAD_OPERATOR_ID;
+        if (encodeOperatorIDMessage(&operator_id, &data.OperatorID) != ODID_SUCCESS) {
+            bad |= ODID_BAD_OPERATOR_ID;
+        }
+    }
+
+    /*
+      the valid flags can change without the data changing, e.g. the
+      location becoming valid on its first message
+     */
+    bool valid_changed = false;
+    const bool valid[] {
+        UAS_data.LocationValid == 1,
+        UAS_data.BasicIDValid[0] == 1,
+        UAS_data.BasicIDValid[1] == 1,
+        UAS_data.SelfIDValid == 1,
+        UAS_data.SystemValid == 1,
+        UAS_data.OperatorIDValid == 1,
+    };
+    bool *cached[] {
+        &location_valid,
+        &basic_id_valid[0],
+        &basic_id_valid[1],
+        &self_id_valid,
+        &system_valid,
+        &operator_id_valid,
+    };
+    for (uint8_t i=0; i<ARRAY_SIZE(valid); i++) {
+        if (*cached[i] != valid[i]) {
+            *cached[i] = valid[i];
+            valid_changed = true;
+        }
+    }
+
+    if (changed != 0 || valid_changed) {
+        build_pack();
+    }
+    return bad;
+}
+
+/*
+  same messages and order as odid_message_build_pack(), from the
+  encoded buffers. Like it, no pack is sent if any valid message
+  failed to encode
+ */
+void ODIDCache::build_pack(void)
+{
+    pack_generation++;
+    pack_length = 0;
+
+    const bool valid_bad[] {
+        basic_id_valid[0] && (bad & ODID_BAD_BASIC_ID_1),
+        basic_id_valid[1] && (bad & ODID_BAD_BASIC_ID_2),
+        location_valid && (bad & ODID_BAD_LOCATION),
+        self_id_valid && (bad & ODID_BAD_SELF_ID),
+        system_valid && (bad & ODID_BAD_SYSTEM),
+        operator_id_valid && (bad & ODID_BAD_OPERATOR_ID),
+    };
+    for (const bool b : valid_bad) {
+        if (b) {
+            return;
+        }
+    }
+
+    ODID_MessagePack_data pack_data {};
+    pack_data.SingleMessageSize = ODID_MESSAGE_SIZE;
+    pack_data.MsgPackSize = 0;
+
+    const void *messages[] {
+        get_basic_id(0),
+        get_basic_id(1),
+        get_location(),
+        get_self_id(),
+        get_system(),
+        get_operator_id(),
+    };
+    for (const void *msg : messages) {
+        if (msg != nullptr && pack_data.MsgPackSize < ODID_PACK_MAX_MESSAGES) {
+            memcpy(&pack_data.Messages[pack_data.MsgPackSize++], msg, ODID_MESSAGE_SIZE);
+        }
+    }
+
+    if (pack_data.MsgPackSize == 0) {
+        return;
+    }
+    memset(&pack, 0, sizeof(pack));
+    if (encodeMessagePack(&pack, &pack_data) != ODID_SUCCESS) {
+        return;
+    }
+    pack_length = sizeof(pack) - (ODID_PACK_MAX_MESSAGES - pack_data.MsgPackSize) * ODID_MESSAGE_SIZE;
+}
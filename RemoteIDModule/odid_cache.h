@@ -0,0 +1,103 @@
+/*
+  encoded OpenDroneID messages shared by the transmitters
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <opendroneid.h>
+
+// parts of ODID_UAS_Data, for only rebuilding and encoding what changed
+#define UAS_PART_LOCATION (1U<<0)
+#define UAS_PART_SYSTEM (1U<<1)
+#define UAS_PART_BASIC_ID (1U<<2)
+#define UAS_PART_SELF_ID (1U<<3)
+#define UAS_PART_OPERATOR_ID (1U<<4)
+#define UAS_PART_ALL 0x1F
+
+// messages that failed to encode
+#define ODID_BAD_LOCATION (1U<<0)
+#define ODID_BAD_SYSTEM (1U<<1)
+#define ODID_BAD_BASIC_ID_1 (1U<<2)
+#define ODID_BAD_BASIC_ID_2 (1U<<3)
+#define ODID_BAD_SELF_ID (1U<<4)
+#define ODID_BAD_OPERATOR_ID (1U<<5)
+
+/*
+  one encoded buffer per message type plus the message pack built from
+  them. Only refreshed for the parts of UAS_data that changed, so WiFi
+  NAN, WiFi beacon, BT4 and BT5 copy the same bytes instead of each
+  encoding them again
+ */
+class ODIDCache {
+public:
+    /*
+      encode the parts of UAS_data in changed (UAS_PART_*) and rebuild
+      the pack if needed. Returns the messages that failed to encode
+      (ODID_BAD_*), including the ones not changed this time
+     */
+    uint8_t update(const ODID_UAS_Data &UAS_data, uint8_t changed);
+
+    // the encoded messages, nullptr when not valid or not encodable
+    const ODID_Location_encoded *get_location(void) const
+    {
+        return have(ODID_BAD_LOCATION, location_valid) ? &location : nullptr;
+    }
+
+    const ODID_BasicID_encoded *get_basic_id(uint8_t i) const
+    {
+        return have(i == 0 ? ODID_BAD_BASIC_ID_1 : ODID_BAD_BASIC_ID_2, basic_id_valid[i]) ? &basic_id[i] : nullptr;
+    }
+
+    const ODID_SelfID_encoded *get_self_id(void) const
+    {
+        return have(ODID_BAD_SELF_ID, self_id_valid) ? &self_id : nullptr;
+    }
+
+    const ODID_System_encoded *get_system(void) const
+    {
+        return have(ODID_BAD_SYSTEM, system_valid) ? &system : nullptr;
+    }
+
+    const ODID_OperatorID_encoded *get_operator_id(void) const
+    {
+        return have(ODID_BAD_OPERATOR_ID, operator_id_valid) ? &operator_id : nullptr;
+    }
+
+    // message pack of all the available messages, length 0 when there are none or one failed to encode
+    const uint8_t *get_pack(uint16_t &length) const
+    {
+        length = pack_length;
+        return (const uint8_t *)&pack;
+    }
+
+    // changes each time the pack is rebuilt
+    uint32_t get_pack_generation(void) const
+    {
+        return pack_generation;
+    }
+
+private:
+    bool have(uint8_t bad_bit, bool valid) const
+    {
+        return valid && !(bad & bad_bit);
+    }
+    void build_pack(void);
+
+    uint8_t bad;
+
+    ODID_Location_encoded location;
+    ODID_BasicID_encoded basic_id[ODID_BASIC_ID_MAX_MESSAGES];
+    ODID_SelfID_encoded self_id;
+    ODID_System_encoded system;
+    ODID_OperatorID_encoded operator_id;
+    bool location_valid;
+    bool basic_id_valid[ODID_BASIC_ID_MAX_MESSAGES];
+    bool self_id_valid;
+    bool system_valid;
+    bool operator_id_valid;
+
+    ODID_MessagePack_encoded pack;
+    uint16_t pack_length;
+    uint32_t pack_generation;
+};
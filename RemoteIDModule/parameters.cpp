@@ -2,12 +2,51 @@
 #include <Arduino.h>
 #include "parameters.h"
 #include <nvs_flash.h>
+#include <esp_system.h>
 #include <string.h>
 #include "romfs.h"
 #include "util.h"
+#include "flt_log.h"
 
 Parameters g;
 static nvs_handle handle;
+static Parameters::float_change_hook_t float_change_hook;
+static uint32_t generation;
+
+/*
+  name lookup: a seed is picked at init so every name has its own
+  slot, then find() is one hash and one compare
+ */
+#define PARAM_HASH_SIZE 256 // power of 2, a few times the parameter count so a seed is quick to find
+#define PARAM_HASH_MAX_SEEDS 1000
+static uint8_t hash_table[PARAM_HASH_SIZE]; // index+1 into params[], 0 when empty
+static uint32_t hash_seed;
+static bool hash_ready;
+
+#define PARAM_NVS_NAMESPACE "storage"
+
+/*
+  boot snapshot: all the values packed into one NVS blob, so a normal
+  boot is a single read. The separate keys stay the master copy, the
+  blob is erased before any of them is written and saved again by the
+  next init() that had to read the keys. The layout tag covers the
+  names, types and defaults, so a firmware with a different table
+  ignores the blob
+ */
+#define PARAM_SNAPSHOT_KEY "PARAM_SNAP"
+#define PARAM_SNAPSHOT_MAGIC 0x50534E50 // "PNSP"
+#define PARAM_SNAPSHOT_VERSION 1
+#define PARAM_SNAPSHOT_MAX 1024
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length; // of the values after the header
+    uint32_t layout;
+} ParamSnapshotHeader;
+
+static bool snapshot_valid; // the blob matches the keys
+static Parameters::BootStats boot_stats;
 
 const Parameters::Param Parameters::params[] = {
     { "LOCK_LEVEL",        Parameters::ParamType::INT8,  (const void*)&g.lock_level,       0, -1, 2 },
@@ -63,12 +102,19 @@ void Parameters::reset_min_test_distance(){
 #endif
 
 /*
-  get count of parameters capable of being converted to load
+  the parameters that can be sent as floats over MAVLink, built in
+  init() so the index maps both ways without walking params[]
  */
-uint16_t Parameters::param_count_float(void)
+static const Parameters::Param *float_params[ARRAY_SIZE(Parameters::params)];
+static int16_t float_index[ARRAY_SIZE(Parameters::params)];
+static uint16_t float_count;
+
+void Parameters::init_float_index(void)
 {
-    uint16_t count = 0;
-    for (const auto &p : params) {
+    float_count = 0;
+    for (uint16_t i=0; i<ARRAY_SIZE(params); i++) {
+        const auto &p = params[i];
+        float_index[i] = -1;
         if (p.flags & PARAM_FLAG_HIDDEN) {
             continue;
         }
@@ -77,12 +123,21 @@ uint16_t Parameters::param_count_float(void)
         case ParamType::INT8:
         case ParamType::UINT32:
         case ParamType::FLOAT:
-            count++;
+            float_index[i] = float_count;
+            float_params[float_count++] = &p;
+            break;
+        default:
             break;
         }
     }
-    // remove 1 for DONE_INIT
-    return count-1;
+}
+
+/*
+  get count of parameters capable of being converted to load
+ */
+uint16_t Parameters::param_count_float(void)
+{
+    return float_count;
 }
 
 /*
@@ -90,24 +145,43 @@ uint16_t Parameters::param_count_float(void)
  */
 int16_t Parameters::param_index_float(const Parameters::Param *f)
 {
-    uint16_t count = 0;
-    for (const auto &p : params) {
-        if (p.flags & PARAM_FLAG_HIDDEN) {
-            continue;
-        }
-        switch (p.ptype) {
-        case ParamType::UINT8:
-        case ParamType::INT8:
-        case ParamType::UINT32:
-        case ParamType::FLOAT:
-            if (&p == f) {
-                return count;
+    if (f < &params[0] || f >= &params[ARRAY_SIZE(params)]) {
+        return -1;
+    }
+    return float_index[f - &params[0]];
+}
+
+static uint8_t hash_slot(const char *name, uint32_t seed)
+{
+    // FNV-1a
+    uint32_t h = 2166136261U ^ seed;
+    for (; *name; name++) {
+        h ^= uint8_t(*name);
+        h *= 16777619U;
+    }
+    return (h ^ (h >> 16)) & (PARAM_HASH_SIZE-1);
+}
+
+void Parameters::init_hash(void)
+{
+    for (uint32_t seed=0; seed<PARAM_HASH_MAX_SEEDS; seed++) {
+        memset(hash_table, 0, sizeof(hash_table));
+        bool ok = true;
+        for (uint8_t i=0; params[i].ptype != ParamType::NONE; i++) {
+            const uint8_t slot = hash_slot(params[i].name, seed);
+            if (hash_table[slot] != 0) {
+                ok = false;
+                break;
             }
-            count++;
-            break;
+            hash_table[slot] = i+1;
+        }
+        if (ok) {
+            hash_seed = seed;
+            hash_ready = true;
+            return;
         }
     }
-    return -1;
+    Serial.printf("No parameter hash seed found\n");
 }
 
 /*
@@ -115,6 +189,13 @@ int16_t Parameters::param_index_float(const Parameters::Param *f)
  */
 const Parameters::Param *Parameters::find(const char *name)
 {
+    if (hash_ready) {
+        const uint8_t i = hash_table[hash_slot(name, hash_seed)];
+        if (i != 0 && strcmp(name, params[i-1].name) == 0) {
+            return &params[i-1];
+        }
+        return nullptr;
+    }
     for (const auto &p : params) {
         if (strcmp(name, p.name) == 0) {
             return &p;
@@ -139,35 +220,109 @@ const Parameters::Param *Parameters::find_by_index(uint16_t index)
  */
 const Parameters::Param *Parameters::find_by_index_float(uint16_t index)
 {
-    uint16_t count = 0;
-    for (const auto &p : params) {
-        if (p.flags & PARAM_FLAG_HIDDEN) {
+    if (index >= float_count) {
+        return nullptr;
+    }
+    return float_params[index];
+}
+
+/*
+  sets only change the value in RAM and mark the parameter dirty.
+  flush() writes the dirty ones to NVS with one commit, so a parameter
+  set many times between flushes costs one flash write
+ */
+static uint32_t dirty[(ARRAY_SIZE(Parameters::params)+31)/32];
+static Parameters::NVSStats nvs_stats;
+
+static void set_dirty(const Parameters::Param *p, bool changed)
+{
+    generation++;
+    nvs_stats.sets++;
+    const uint16_t i = p - &Parameters::params[0];
+    if (!changed || (dirty[i/32] & (1U<<(i%32)))) {
+        nvs_stats.writes_avoided++;
+        return;
+    }
+    dirty[i/32] |= 1U<<(i%32);
+}
+
+void Parameters::flush(void)
+{
+    const uint32_t start_us = micros();
+    bool wrote = false;
+    for (uint16_t i=0; i<ARRAY_SIZE(params); i++) {
+        if (!(dirty[i/32] & (1U<<(i%32)))) {
             continue;
         }
+        dirty[i/32] &= ~(1U<<(i%32));
+        if (snapshot_valid) {
+            // the keys are about to differ from it
+            nvs_erase_key(handle, PARAM_SNAPSHOT_KEY);
+            snapshot_valid = false;
+        }
+        const auto &p = params[i];
         switch (p.ptype) {
         case ParamType::UINT8:
+            nvs_set_u8(handle, p.name, *(const uint8_t *)p.ptr);
+            break;
         case ParamType::INT8:
+            nvs_set_i8(handle, p.name, *(const int8_t *)p.ptr);
+            break;
         case ParamType::UINT32:
         case ParamType::FLOAT:
-            if (index == count) {
-                return &p;
-            }
-            count++;
+            nvs_set_u32(handle, p.name, *(const uint32_t *)p.ptr);
+            break;
+        case ParamType::CHAR20:
+        case ParamType::CHAR64:
+            nvs_set_str(handle, p.name, (const char *)p.ptr);
+            break;
+        default:
             break;
         }
+        nvs_stats.flash_writes++;
+        wrote = true;
     }
-    return nullptr;
+    if (!wrote) {
+        return;
+    }
+    if (nvs_commit(handle) != ESP_OK) {
+        Serial.printf("NVS commit failed\n");
+    }
+    nvs_stats.commits++;
+    nvs_stats.nvs_us += micros() - start_us;
+}
+
+void Parameters::get_nvs_stats(NVSStats &stats)
+{
+    stats = nvs_stats;
+}
+
+/*
+  erase all parameters and reboot, without flushing what is pending
+ */
+static void factory_reset(void)
+{
+    memset(dirty, 0, sizeof(dirty));
+    nvs_flash_erase();
+    flt_log.erase();
+    esp_restart();
+}
+
+// pending writes are not lost on esp_restart()
+static void shutdown_flush(void)
+{
+    g.flush();
 }
 
 void Parameters::Param::set_uint8(uint8_t v) const
 {
     auto *p = (uint8_t *)ptr;
+    const bool changed = *p != v;
     *p = v;
-    nvs_set_u8(handle, name, *p);
+    set_dirty(this, changed);
     if (strcmp(name, "TO_DEFAULTS") == 0) {
         if (v == 1) {
-            nvs_flash_erase();
-            esp_restart();
+            factory_reset();
         }
     }
 }
@@ -175,27 +330,44 @@ void Parameters::Param::set_uint8(uint8_t v) const
 void Parameters::Param::set_int8(int8_t v) const
 {
     auto *p = (int8_t *)ptr;
+    const bool changed = *p != v;
     *p = v;
-    nvs_set_i8(handle, name, *p);
+    set_dirty(this, changed);
 }
 
 void Parameters::Param::set_uint32(uint32_t v) const
 {
+    // the flight time is kept in the fltlog partition when there is one
+    if ((ptr == &g.flt_time || ptr == &g.flt_time_aux) && flt_log.active()) {
+        flt_log.update(ptr == &g.flt_time ? v : g.flt_time,
+                       ptr == &g.flt_time_aux ? v : g.flt_time_aux);
+        return;
+    }
     auto *p = (uint32_t *)ptr;
+    const bool changed = *p != v;
     *p = v;
-    nvs_set_u32(handle, name, *p);
+    set_dirty(this, changed);
 }
 
 void Parameters::Param::set_float(float v) const
 {
     auto *p = (float *)ptr;
+    const bool changed = memcmp(p, &v, sizeof(v)) != 0;
     *p = v;
-    union {
-        float f;
-        uint32_t u32;
-    } u;
-    u.f = v;
-    nvs_set_u32(handle, name, u.u32);
+    set_dirty(this, changed);
+    if (float_change_hook != nullptr) {
+        float_change_hook(this);
+    }
+}
+
+void Parameters::set_float_change_hook(float_change_hook_t hook)
+{
+    float_change_hook = hook;
+}
+
+uint32_t Parameters::get_generation(void)
+{
+    return generation;
 }
 
 void Parameters::Param::set_char20(const char *v) const
@@ -203,9 +375,10 @@ void Parameters::Param::set_char20(const char *v) const
     if (min_len > 0 && strlen(v) < min_len) {
         return;
     }
+    const bool changed = strncmp((const char *)ptr, v, 20) != 0;
     memset((void*)ptr, 0, 21);
     strncpy((char *)ptr, v, 20);
-    nvs_set_str(handle, name, v);
+    set_dirty(this, changed);
 }
 
 void Parameters::Param::set_char64(const char *v) const
@@ -213,9 +386,10 @@ void Parameters::Param::set_char64(const char *v) const
     if (min_len > 0 && strlen(v) < min_len) {
         return;
     }
+    const bool changed = strncmp((const char *)ptr, v, 64) != 0;
     memset((void*)ptr, 0, 65);
     strncpy((char *)ptr, v, 64);
-    nvs_set_str(handle, name, v);
+    set_dirty(this, changed);
 }
 
 uint8_t Parameters::Param::get_uint8() const
@@ -323,41 +497,176 @@ void Parameters::load_defaults(void)
     }
 }
 
-void Parameters::init(void)
-{
-    load_defaults();
-
-    if (nvs_flash_init() != ESP_OK ||
-        nvs_open("storage", NVS_READWRITE, &handle) != ESP_OK) {
-        Serial.printf("NVS init failed\n");
-    }
-    // load values from NVS
-    for (const auto &p : params) {
-        switch (p.ptype) {
+/*
+  one pass over the keys that are stored, most parameters are never set
+  so this saves a failed lookup for each of them
+ */
+void Parameters::load_nvs(void)
+{
+    nvs_iterator_t it = nvs_entry_find(NVS_DEFAULT_PART_NAME, PARAM_NVS_NAMESPACE, NVS_TYPE_ANY);
+    while (it != nullptr) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        it = nvs_entry_next(it);
+        boot_stats.nvs_entries++;
+        const Param *p = find(info.key);
+        if (p == nullptr) {
+            continue;
+        }
+        switch (p->ptype) {
         case ParamType::UINT8:
-            nvs_get_u8(handle, p.name, (uint8_t *)p.ptr);
+            if (info.type == NVS_TYPE_U8) {
+                nvs_get_u8(handle, p->name, (uint8_t *)p->ptr);
+            }
             break;
         case ParamType::INT8:
-            nvs_get_i8(handle, p.name, (int8_t *)p.ptr);
+            if (info.type == NVS_TYPE_I8) {
+                nvs_get_i8(handle, p->name, (int8_t *)p->ptr);
+            }
             break;
         case ParamType::UINT32:
-            nvs_get_u32(handle, p.name, (uint32_t *)p.ptr);
-            break;
         case ParamType::FLOAT:
-            nvs_get_u32(handle, p.name, (uint32_t *)p.ptr);
+            if (info.type == NVS_TYPE_U32) {
+                nvs_get_u32(handle, p->name, (uint32_t *)p->ptr);
+            }
             break;
         case ParamType::CHAR20: {
             size_t len = 21;
-            nvs_get_str(handle, p.name, (char *)p.ptr, &len);
+            if (info.type == NVS_TYPE_STR) {
+                nvs_get_str(handle, p->name, (char *)p->ptr, &len);
+            }
             break;
         }
         case ParamType::CHAR64: {
             size_t len = 65;
-            nvs_get_str(handle, p.name, (char *)p.ptr, &len);
+            if (info.type == NVS_TYPE_STR) {
+                nvs_get_str(handle, p->name, (char *)p->ptr, &len);
+            }
             break;
         }
+        default:
+            break;
+        }
+    }
+}
+
+static uint8_t snapshot_value_size(Parameters::ParamType ptype)
+{
+    switch (ptype) {
+    case Parameters::ParamType::UINT8:
+    case Parameters::ParamType::INT8:
+        return 1;
+    case Parameters::ParamType::UINT32:
+    case Parameters::ParamType::FLOAT:
+        return 4;
+    case Parameters::ParamType::CHAR20:
+        return 21;
+    case Parameters::ParamType::CHAR64:
+        return 64;
+    default:
+        return 0;
+    }
+}
+
+// FNV-1a over what the snapshot depends on
+static uint32_t snapshot_layout(void)
+{
+    uint32_t h = 2166136261U;
+    for (const auto &p : Parameters::params) {
+        uint8_t bytes[PARAM_NAME_MAX_LEN+1+1+sizeof(float)] {};
+        strncpy((char *)bytes, p.name, PARAM_NAME_MAX_LEN);
+        bytes[PARAM_NAME_MAX_LEN+1] = uint8_t(p.ptype);
+        memcpy(&bytes[PARAM_NAME_MAX_LEN+2], &p.default_value, sizeof(float));
+        for (uint8_t i=0; i<sizeof(bytes); i++) {
+            h = (h ^ bytes[i]) * 16777619U;
+        }
+    }
+    return h;
+}
+
+bool Parameters::load_snapshot(void)
+{
+    uint8_t buf[PARAM_SNAPSHOT_MAX];
+    size_t len = sizeof(buf);
+    if (nvs_get_blob(handle, PARAM_SNAPSHOT_KEY, buf, &len) != ESP_OK ||
+        len < sizeof(ParamSnapshotHeader)) {
+        return false;
+    }
+    ParamSnapshotHeader hdr;
+    memcpy(&hdr, buf, sizeof(hdr));
+    uint32_t length = 0;
+    for (const auto &p : params) {
+        length += snapshot_value_size(p.ptype);
+    }
+    if (hdr.magic != PARAM_SNAPSHOT_MAGIC ||
+        hdr.version != PARAM_SNAPSHOT_VERSION ||
+        hdr.length != length ||
+        sizeof(hdr) + length != len ||
+        hdr.layout != snapshot_layout()) {
+        return false;
+    }
+    uint32_t ofs = sizeof(hdr);
+    for (const auto &p : params) {
+        const uint8_t size = snapshot_value_size(p.ptype);
+        memcpy((void *)p.ptr, &buf[ofs], size);
+        ofs += size;
+    }
+    return true;
+}
+
+void Parameters::save_snapshot(void)
+{
+    uint8_t buf[PARAM_SNAPSHOT_MAX];
+    ParamSnapshotHeader hdr {};
+    uint32_t ofs = sizeof(hdr);
+    for (const auto &p : params) {
+        const uint8_t size = snapshot_value_size(p.ptype);
+        if (ofs + size > sizeof(buf)) {
+            Serial.printf("Parameter snapshot too large\n");
+            return;
         }
+        memcpy(&buf[ofs], p.ptr, size);
+        ofs += size;
+    }
+    hdr.magic = PARAM_SNAPSHOT_MAGIC;
+    hdr.version = PARAM_SNAPSHOT_VERSION;
+    hdr.length = ofs - sizeof(hdr);
+    hdr.layout = snapshot_layout();
+    memcpy(buf, &hdr, sizeof(hdr));
+    if (nvs_set_blob(handle, PARAM_SNAPSHOT_KEY, buf, ofs) != ESP_OK ||
+        nvs_commit(handle) != ESP_OK) {
+        Serial.printf("Parameter snapshot save failed\n");
+        return;
     }
+    snapshot_valid = true;
+}
+
+void Parameters::get_boot_stats(BootStats &stats)
+{
+    stats = boot_stats;
+}
+
+void Parameters::init(void)
+{
+    const uint32_t start_us = micros();
+    init_hash();
+    init_float_index();
+
+    if (nvs_flash_init() != ESP_OK ||
+        nvs_open(PARAM_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        Serial.printf("NVS init failed\n");
+    }
+    esp_register_shutdown_handler(shutdown_flush);
+
+    // load values from the snapshot, or else the defaults and NVS
+    const uint32_t load_start_us = micros();
+    boot_stats.from_snapshot = load_snapshot();
+    snapshot_valid = boot_stats.from_snapshot;
+    if (!boot_stats.from_snapshot) {
+        load_defaults();
+        load_nvs();
+    }
+    boot_stats.load_us = micros() - load_start_us;
 
     if (strlen(g.wifi_ssid) == 0) {
         uint8_t mac[6] {};
@@ -368,8 +677,7 @@ void Parameters::init(void)
     }
     if (g.to_factory_defaults == 1) {
         //should not happen, but in case the parameter is still set to 1, erase flash and reboot
-        nvs_flash_erase();
-        esp_restart();
+        factory_reset();
     }
 #if defined(BOARD_AURELIA_RID_S3)
     reset_min_test_distance();
@@ -389,6 +697,12 @@ void Parameters::init(void)
         set_by_name_char64("PUBLIC_KEY4", ROMFS::find_string("public_keys/AureliaKeys_public_key1.dat"));
 #endif
     }
+    // keep what init() set, e.g. the public keys on first boot
+    flush();
+    if (!snapshot_valid) {
+        save_snapshot();
+    }
+    boot_stats.init_us = micros() - start_us;
 }
 
 int32_t Parameters::get_serial_number(){
@@ -10,6 +10,8 @@
 #define PARAM_FLAG_PASSWORD (1U<<0)
 #define PARAM_FLAG_HIDDEN (1U<<1)
 
+#define PARAM_FLUSH_MS 2000 // how often changed parameters are written to NVS
+
 class Parameters {
 public:
     int8_t lock_level;
@@ -89,6 +91,33 @@ public:
     };
     static const struct Param params[];
 
+    // called after set_float() has changed a parameter
+    typedef void (*float_change_hook_t)(const Param *p);
+    static void set_float_change_hook(float_change_hook_t hook);
+
+    // bumped by every parameter set, to spot changes without comparing values
+    static uint32_t get_generation(void);
+
+    // write changed parameters to NVS, called every PARAM_FLUSH_MS and on esp_restart()
+    void flush(void);
+
+    struct NVSStats {
+        uint32_t sets;           // parameter set calls
+        uint32_t writes_avoided; // sets that didn't need a flash write
+        uint32_t flash_writes;
+        uint32_t commits;
+        uint32_t nvs_us;         // time spent writing and committing
+    };
+    static void get_nvs_stats(NVSStats &stats);
+
+    struct BootStats {
+        bool from_snapshot;   // loaded from the snapshot blob, not the separate keys
+        uint16_t nvs_entries; // keys seen by the NVS scan
+        uint32_t load_us;
+        uint32_t init_us;     // all of init(), including any writes
+    };
+    static void get_boot_stats(BootStats &stats);
+
     static const Param *find(const char *name);
     static const Param *find_by_index(uint16_t idx);
     static const Param *find_by_index_float(uint16_t idx);
@@ -121,6 +150,11 @@ public:
 
 private:
     void load_defaults(void);
+    void load_nvs(void);
+    bool load_snapshot(void);
+    void save_snapshot(void);
+    static void init_hash(void);
+    static void init_float_index(void);
 };
 
 // bits for OPTIONS parameter
@@ -0,0 +1,112 @@
+/*
+  deadline scheduler for the main loop and the radio tasks
+ */
+
+#include "scheduler.h"
+
+int8_t Scheduler::add(slot_fn_t fn, uint32_t period_ms, uint32_t now_ms)
+{
+    if (slot_count >= SCHEDULER_MAX_SLOTS) {
+        return -1;
+    }
+    const uint8_t id = slot_count++;
+    slots[id].fn = fn;
+    slots[id].period_ms = period_ms;
+    slots[id].next_ms = now_ms;
+    rebuild();
+    return id;
+}
+
+void Scheduler::set_period(int8_t id, uint32_t period_ms, uint32_t now_ms)
+{
+    if (id < 0 || id >= slot_count || slots[id].period_ms == period_ms) {
+        return;
+    }
+    slots[id].period_ms = period_ms;
+    slots[id].next_ms = now_ms + period_ms;
+    rebuild();
+}
+
+void Scheduler::trigger(int8_t id, uint32_t now_ms)
+{
+    if (id < 0 || id >= slot_count || slots[id].period_ms == 0) {
+        return;
+    }
+    if (int32_t(slots[id].next_ms - now_ms) > 0) {
+        slots[id].next_ms = now_ms;
+        rebuild();
+    }
+}
+
+uint32_t Scheduler::run(uint32_t now_ms, uint32_t max_wait_ms)
+{
+    while (heap_size > 0) {
+        const uint8_t id = heap[0];
+        Slot &slot = slots[id];
+        const int32_t wait_ms = int32_t(slot.next_ms - now_ms);
+        if (wait_ms > 0) {
+            return uint32_t(wait_ms) < max_wait_ms ? uint32_t(wait_ms) : max_wait_ms;
+        }
+        slot.next_ms += slot.period_ms;
+        if (int32_t(slot.next_ms - now_ms) <= 0) {
+            // we fell behind, don't try to catch up with a burst
+            slot.next_ms = now_ms + slot.period_ms;
+        }
+        sift_down(0);
+        slot.fn(now_ms);
+    }
+    return max_wait_ms;
+}
+
+void Scheduler::sift_up(uint8_t i)
+{
+    while (i > 0) {
+        const uint8_t parent = (i - 1) / 2;
+        if (!before(heap[i], heap[parent])) {
+            break;
+        }
+        const uint8_t tmp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = tmp;
+        i = parent;
+    }
+}
+
+void Scheduler::sift_down(uint8_t i)
+{
+    while (true) {
+        const uint8_t left = 2 * i + 1;
+        const uint8_t right = left + 1;
+        uint8_t first = i;
+        if (left < heap_size && before(heap[left], heap[first])) {
+            first = left;
+        }
+        if (right < heap_size && before(heap[right], heap[first])) {
+            first = right;
+        }
+        if (first == i) {
+            return;
+        }
+        const uint8_t tmp = heap[i];
+        heap[i] = heap[first];
+        heap[first] = tmp;
+        i = first;
+    }
+}
+
+/*
+  put the enabled slots back in the heap, only needed when a period
+  changes so simpler than removing a single entry
+ */
+void Scheduler::rebuild(void)
+{
+    heap_size = 0;
+    for (uint8_t id=0; id<slot_count; id++) {
+        if (slots[id].period_ms == 0) {
+            continue;
+        }
+        heap[heap_size] = id;
+        sift_up(heap_size);
+        heap_size++;
+    }
+}
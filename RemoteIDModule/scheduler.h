@@ -0,0 +1,50 @@
+/*
+  deadline scheduler for the main loop and the radio tasks
+ */
+#pragma once
+
+#include <stdint.h>
+
+#define SCHEDULER_MAX_SLOTS 8
+
+/*
+  periodic slots kept in a binary min-heap of their next deadline, so
+  the main loop can sleep until the earliest one instead of polling
+ */
+class Scheduler {
+public:
+    typedef void (*slot_fn_t)(uint32_t now_ms);
+
+    // add a slot due at now_ms, a period of 0 leaves it disabled. Returns the slot id, or -1 when full
+    int8_t add(slot_fn_t fn, uint32_t period_ms, uint32_t now_ms);
+
+    // change the period of a slot, it is next due one period from now_ms
+    void set_period(int8_t id, uint32_t period_ms, uint32_t now_ms);
+
+    // make a slot due now, e.g. when a transport has received data
+    void trigger(int8_t id, uint32_t now_ms);
+
+    // run the slots that are due, returns the ms until the next one (max_wait_ms at most)
+    uint32_t run(uint32_t now_ms, uint32_t max_wait_ms);
+
+private:
+    struct Slot {
+        slot_fn_t fn;
+        uint32_t period_ms;
+        uint32_t next_ms;
+    };
+
+    // wrap safe deadline order
+    bool before(uint8_t a, uint8_t b) const
+    {
+        return int32_t(slots[a].next_ms - slots[b].next_ms) < 0;
+    }
+    void sift_up(uint8_t i);
+    void sift_down(uint8_t i);
+    void rebuild(void);
+
+    Slot slots[SCHEDULER_MAX_SLOTS];
+    uint8_t slot_count;
+    uint8_t heap[SCHEDULER_MAX_SLOTS]; // slot ids, earliest deadline first
+    uint8_t heap_size;
+};
@@ -7,9 +7,19 @@
 #include <opendroneid.h>
 #include "status.h"
 #include "util.h"
+#include "parameters.h"
+#if AP_MAVLINK_ENABLED
+#include "mavlink.h"
+#endif
+#if AP_DRONECAN_ENABLED
+#include "DroneCAN.h"
+#endif
 
 extern ODID_UAS_Data UAS_data;
 extern String status_reason;
+#if AP_DRONECAN_ENABLED
+extern DroneCAN dronecan;
+#endif
 
 typedef struct {
     String name;
@@ -234,11 +244,91 @@ String status_json(void)
     if (status_reason != nullptr && status_reason.length() > 0) {
         reason = "(" + status_reason + ")";
     }
+#if AP_MAVLINK_ENABLED
+    MAVLinkSerial::RxStats rx_stats;
+    MAVLinkSerial::get_rx_stats(rx_stats);
+    const String mavlink_rx = String(rx_stats.frames) + " ok, " +
+        String(rx_stats.skipped) + " skipped, " +
+        String(rx_stats.crc_errors) + " bad, " +
+        String(rx_stats.ring_overflow) + " dropped, " +
+        String(rx_stats.uart_overflow) + " overflows";
+#endif
+#if AP_DRONECAN_ENABLED
+    DroneCAN::RxStats can_rx_stats;
+    dronecan.get_rx_stats(can_rx_stats);
+    const String dronecan_rx = String(can_rx_stats.frames) + " ok, " +
+        String(can_rx_stats.dropped) + " filtered, " +
+        String(can_rx_stats.backlog) + " waiting (max " +
+        String(can_rx_stats.backlog_max) + ")";
+    // frames per data type ID
+    const uint16_t *can_type_ids;
+    const uint32_t *can_type_counts;
+    const uint8_t can_types = dronecan.get_rx_types(can_type_ids, can_type_counts);
+    String dronecan_rx_types = "";
+    for (uint8_t i=0; i<can_types; i++) {
+        if (can_type_counts[i] == 0) {
+            continue;
+        }
+        if (dronecan_rx_types.length() > 0) {
+            dronecan_rx_types += ", ";
+        }
+        dronecan_rx_types += String(can_type_ids[i]) + ": " + String(can_type_counts[i]);
+    }
+    DroneCAN::TxStats can_tx_stats;
+    dronecan.get_tx_stats(can_tx_stats);
+    const String dronecan_tx = String(can_tx_stats.frames) + " sent, " +
+        String(can_tx_stats.dropped) + " dropped";
+    /*
+      per sent data type, transfers and the slowest latency bin. Bin 0
+      is under 1ms, bin i under 2^i ms and the last 64ms or more
+     */
+    uint8_t can_latency_types;
+    const DroneCAN::TxLatency *can_latency = dronecan.get_tx_latency(can_latency_types);
+    String dronecan_tx_latency = "";
+    for (uint8_t i=0; i<can_latency_types; i++) {
+        const auto &l = can_latency[i];
+        uint32_t transfers = 0;
+        int8_t worst = -1;
+        for (uint8_t b=0; b<CAN_TX_LATENCY_BINS; b++) {
+            transfers += l.bins[b];
+            if (l.bins[b] > 0) {
+                worst = b;
+            }
+        }
+        if (transfers == 0) {
+            continue;
+        }
+        if (dronecan_tx_latency.length() > 0) {
+            dronecan_tx_latency += ", ";
+        }
+        dronecan_tx_latency += String(l.data_type_id) + ": " + String(transfers) + " in ";
+        if (worst == CAN_TX_LATENCY_BINS-1) {
+            dronecan_tx_latency += String(1U<<(worst-1)) + "+ ms";
+        } else {
+            dronecan_tx_latency += "<" + String(1U<<worst) + " ms";
+        }
+    }
+#endif
+    Parameters::NVSStats nvs_stats;
+    Parameters::get_nvs_stats(nvs_stats);
+    const String param_nvs = String(nvs_stats.flash_writes) + " writes, " +
+        String(nvs_stats.writes_avoided) + " avoided, " +
+        String(nvs_stats.nvs_us / 1000) + " ms";
     const json_table_t table[] = {
         { "STATUS:VERSION", String(FW_VERSION_MAJOR) + "." + String(FW_VERSION_MINOR) + " " + githash},
         { "STATUS:BOARD_ID", String(BOARD_ID)},
         { "STATUS:UPTIME", String(hr) + ":" + String(minsec_str) },
         { "STATUS:FREEMEM", String(ESP.getFreeHeap()) },
+#if AP_MAVLINK_ENABLED
+        { "STATUS:MAVLINK_RX", mavlink_rx },
+#endif
+#if AP_DRONECAN_ENABLED
+        { "STATUS:DRONECAN_RX", dronecan_rx },
+        { "STATUS:DRONECAN_RX_TYPES", dronecan_rx_types },
+        { "STATUS:DRONECAN_TX", dronecan_tx },
+        { "STATUS:DRONECAN_TX_LATENCY", dronecan_tx_latency },
+#endif
+        { "STATUS:PARAM_NVS", param_nvs },
         { "BASICID:UAType", ENUM_MAP(uatype, UAS_data.BasicID[0].UAType) },
         { "BASICID:IDType", ENUM_MAP(idtype, UAS_data.BasicID[0].IDType) },
         { "BASICID:UASID", String(UAS_data.BasicID[0].UASID) },
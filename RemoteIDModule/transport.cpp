@@ -30,6 +30,8 @@ mavlink_aurelia_flt_time_t Transport::flt_time;
 mavlink_aurelia_odid_serial_number_t Transport::serial_number;
 mavlink_aurelia_util_ack_request_t Transport::ack_request;
 uint8_t Transport::fl_status = 0;
+uint32_t Transport::generation[uint8_t(Transport::MsgType::COUNT)];
+TaskHandle_t Transport::rx_task;
 
 Transport::Transport()
 {
@@ -3,6 +3,8 @@
  */
 #pragma once
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include "mavlink_msgs.h"
 #include "cipher_config.h"
 
@@ -14,6 +16,22 @@
 class Transport
 {
 public:
+    /*
+      message types with a generation counter, bumped each time a
+      message of that type is received on any transport
+     */
+    enum class MsgType : uint8_t {
+        LOCATION,
+        BASIC_ID,
+        AUTHENTICATION,
+        SELF_ID,
+        SYSTEM,
+        OPERATOR_ID,
+        FLT_TIME,
+        SERIAL_NUMBER,
+        COUNT
+    };
+
     Transport();
     virtual void init(void) = 0;
     virtual void update(void) = 0;
@@ -59,6 +77,11 @@ public:
         return serial_number;
     }
 
+    uint32_t get_generation(MsgType type) const
+    {
+        return generation[uint8_t(type)];
+    }
+
     uint32_t get_last_location_ms(void) const
     {
         return last_location_ms;
@@ -93,6 +116,12 @@ public:
 
     static uint8_t read_file_counter;
 
+    // task to notify when a transport has received data
+    static void set_rx_task(TaskHandle_t task)
+    {
+        rx_task = task;
+    }
+
 protected:
     // common variables between transports. The last message of each
     // type, no matter what transport it was on, wins
@@ -128,6 +157,21 @@ protected:
     static mavlink_aurelia_odid_serial_number_t serial_number;
     static mavlink_aurelia_util_ack_request_t ack_request;
 
+    static uint32_t generation[uint8_t(MsgType::COUNT)];
+
+    void mark_updated(MsgType type)
+    {
+        generation[uint8_t(type)]++;
+    }
+
+    static TaskHandle_t rx_task;
+    static void notify_rx(void)
+    {
+        if (rx_task != nullptr) {
+            xTaskNotifyGive(rx_task);
+        }
+    }
+
     void make_session_key(uint8_t key[8]) const;
 
     /*
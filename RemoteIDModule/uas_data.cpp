@@ -0,0 +1,251 @@
+/*
+  fill in UAS_data from the transport messages and parameters
+ */
+
+#include "options.h"
+#include <string.h>
+#include "uas_data.h"
+#include "odid_cache.h"
+#include "parameters.h"
+
+#define IMIN(x, y) ((x) < (y) ? (x) : (y))
+#define ODID_COPY_STR(to, from) strncpy(to, (const char *)from, IMIN(sizeof(to), sizeof(from)))
+
+/*
+  generations of the transport messages and parameters UAS_data was
+  last built from
+ */
+static struct
+{
+    bool valid;
+    uint32_t location;
+    uint32_t system;
+    uint32_t basic_id;
+    uint32_t self_id;
+    uint32_t operator_id;
+    uint32_t flt_time;
+    uint32_t params;
+} uas_data_gen;
+
+uint8_t uas_data_update(const Transport &t, ODID_UAS_Data &UAS_data, bool &flt_time_changed)
+{
+    const auto &operator_id = t.get_operator_id();
+    const auto &basic_id = t.get_basic_id();
+    const auto &system = t.get_system();
+    const auto &self_id = t.get_self_id();
+    const auto &location = t.get_location();
+
+    uint8_t changed = uas_data_gen.valid ? 0 : UAS_PART_ALL;
+    const uint32_t location_gen = t.get_generation(Transport::MsgType::LOCATION);
+    const uint32_t system_gen = t.get_generation(Transport::MsgType::SYSTEM);
+    const uint32_t basic_id_gen = t.get_generation(Transport::MsgType::BASIC_ID);
+    const uint32_t self_id_gen = t.get_generation(Transport::MsgType::SELF_ID);
+    const uint32_t operator_id_gen = t.get_generation(Transport::MsgType::OPERATOR_ID);
+    const uint32_t flt_time_gen = t.get_generation(Transport::MsgType::FLT_TIME);
+    const uint32_t params_gen = Parameters::get_generation();
+    const bool params_changed = !uas_data_gen.valid || params_gen != uas_data_gen.params;
+    if (location_gen != uas_data_gen.location)
+    {
+        changed |= UAS_PART_LOCATION;
+    }
+    if (system_gen != uas_data_gen.system)
+    {
+        changed |= UAS_PART_SYSTEM;
+    }
+    if (basic_id_gen != uas_data_gen.basic_id || params_changed)
+    {
+        // BasicID comes from the parameters too
+        changed |= UAS_PART_BASIC_ID;
+    }
+    if (self_id_gen != uas_data_gen.self_id)
+    {
+        changed |= UAS_PART_SELF_ID;
+    }
+    if (operator_id_gen != uas_data_gen.operator_id)
+    {
+        changed |= UAS_PART_OPERATOR_ID;
+    }
+    flt_time_changed = flt_time_gen != uas_data_gen.flt_time || params_changed;
+    uas_data_gen.valid = true;
+    uas_data_gen.location = location_gen;
+    uas_data_gen.system = system_gen;
+    uas_data_gen.basic_id = basic_id_gen;
+    uas_data_gen.self_id = self_id_gen;
+    uas_data_gen.operator_id = operator_id_gen;
+    uas_data_gen.flt_time = flt_time_gen;
+    uas_data_gen.params = params_gen;
+
+    /*
+      if we don't have BasicID info from parameters and we have it
+      from the DroneCAN or MAVLink transport then copy it to the
+      parameters to persist it. This makes it possible to set the
+      UAS_ID string via a MAVLink BASIC_ID message and also offers a
+      migration path from the old approach of GCS setting these values
+      to having them as parameters
+
+      BasicID 2 can be set in parameters, or provided via mavlink We
+      don't persist the BasicID2 if provided via mavlink to allow
+      users to change BasicID2 on different days
+     */
+    if ((changed & UAS_PART_BASIC_ID) && !g.have_basic_id_info() && !(g.options & OPTIONS_DONT_SAVE_BASIC_ID_TO_PARAMETERS))
+    {
+        if (basic_id.ua_type != 0 &&
+            basic_id.id_type != 0 &&
+            strnlen((const char *)basic_id.uas_id, 20) > 0)
+        {
+            g.set_by_name_uint8("UAS_TYPE", basic_id.ua_type);
+            g.set_by_name_uint8("UAS_ID_TYPE", basic_id.id_type);
+            char uas_id[21]{};
+            ODID_COPY_STR(uas_id, basic_id.uas_id);
+            g.set_by_name_string("UAS_ID", uas_id);
+        }
+    }
+
+    // BasicID
+    if (changed & UAS_PART_BASIC_ID)
+    {
+        odid_initBasicIDData(&UAS_data.BasicID[0]);
+        odid_initBasicIDData(&UAS_data.BasicID[1]);
+        UAS_data.BasicIDValid[0] = 0;
+        UAS_data.BasicIDValid[1] = 0;
+    }
+    if ((changed & UAS_PART_BASIC_ID) && g.have_basic_id_info() && !(g.options & OPTIONS_DONT_SAVE_BASIC_ID_TO_PARAMETERS))
+    {
+        // from parameters
+        UAS_data.BasicID[0].UAType = (ODID_uatype_t)g.ua_type;
+        UAS_data.BasicID[0].IDType = (ODID_idtype_t)g.id_type;
+        ODID_COPY_STR(UAS_data.BasicID[0].UASID, g.uas_id);
+        UAS_data.BasicIDValid[0] = 1;
+
+        // BasicID 2
+        if (g.have_basic_id_2_info())
+        {
+            // from parameters
+            UAS_data.BasicID[1].UAType = (ODID_uatype_t)g.ua_type_2;
+            UAS_data.BasicID[1].IDType = (ODID_idtype_t)g.id_type_2;
+            ODID_COPY_STR(UAS_data.BasicID[1].UASID, g.uas_id_2);
+            UAS_data.BasicIDValid[1] = 1;
+        }
+        else if (strcmp((const char *)g.uas_id, (const char *)basic_id.uas_id) != 0)
+        {
+            /*
+              no BasicID 2 in the parameters, if one is provided on MAVLink
+              and it is a different uas_id from the basicID1 then use it as BasicID2
+            */
+            if (basic_id.ua_type != 0 &&
+                basic_id.id_type != 0 &&
+                strnlen((const char *)basic_id.uas_id, 20) > 0)
+            {
+                UAS_data.BasicID[1].UAType = (ODID_uatype_t)basic_id.ua_type;
+                UAS_data.BasicID[1].IDType = (ODID_idtype_t)basic_id.id_type;
+                ODID_COPY_STR(UAS_data.BasicID[1].UASID, basic_id.uas_id);
+                UAS_data.BasicIDValid[1] = 1;
+            }
+        }
+    }
+
+    if ((changed & UAS_PART_BASIC_ID) && (g.options & OPTIONS_DONT_SAVE_BASIC_ID_TO_PARAMETERS))
+    {
+        if (basic_id.ua_type != 0 &&
+            basic_id.id_type != 0 &&
+            strnlen((const char *)basic_id.uas_id, 20) > 0)
+        {
+            if (strcmp((const char *)UAS_data.BasicID[0].UASID, (const char *)basic_id.uas_id) != 0 && strnlen((const char *)basic_id.uas_id, 20) > 0)
+            {
+                UAS_data.BasicID[1].UAType = (ODID_uatype_t)basic_id.ua_type;
+                UAS_data.BasicID[1].IDType = (ODID_idtype_t)basic_id.id_type;
+                ODID_COPY_STR(UAS_data.BasicID[1].UASID, basic_id.uas_id);
+                UAS_data.BasicIDValid[1] = 1;
+            }
+            else
+            {
+                UAS_data.BasicID[0].UAType = (ODID_uatype_t)basic_id.ua_type;
+                UAS_data.BasicID[0].IDType = (ODID_idtype_t)basic_id.id_type;
+                ODID_COPY_STR(UAS_data.BasicID[0].UASID, basic_id.uas_id);
+                UAS_data.BasicIDValid[0] = 1;
+            }
+        }
+    }
+
+    // OperatorID
+    if (changed & UAS_PART_OPERATOR_ID)
+    {
+        odid_initOperatorIDData(&UAS_data.OperatorID);
+        UAS_data.OperatorIDValid = 0;
+    }
+    if ((changed & UAS_PART_OPERATOR_ID) && strlen(operator_id.operator_id) > 0)
+    {
+        UAS_data.OperatorID.OperatorIdType = (ODID_operatorIdType_t)operator_id.operator_id_type;
+        ODID_COPY_STR(UAS_data.OperatorID.OperatorId, operator_id.operator_id);
+        UAS_data.OperatorIDValid = 1;
+    }
+
+    // SelfID
+    if (changed & UAS_PART_SELF_ID)
+    {
+        odid_initSelfIDData(&UAS_data.SelfID);
+        UAS_data.SelfIDValid = 0;
+    }
+    if ((changed & UAS_PART_SELF_ID) && strlen(self_id.description) > 0)
+    {
+        UAS_data.SelfID.DescType = (ODID_desctype_t)self_id.description_type;
+        ODID_COPY_STR(UAS_data.SelfID.Desc, self_id.description);
+        UAS_data.SelfIDValid = 1;
+    }
+
+    // System
+    if (changed & UAS_PART_SYSTEM)
+    {
+        odid_initSystemData(&UAS_data.System);
+        UAS_data.SystemValid = 0;
+    }
+    if ((changed & UAS_PART_SYSTEM) && system.timestamp != 0)
+    {
+        UAS_data.System.OperatorLocationType = (ODID_operator_location_type_t)system.operator_location_type;
+        UAS_data.System.ClassificationType = (ODID_classification_type_t)system.classification_type;
+        UAS_data.System.OperatorLatitude = system.operator_latitude * 1.0e-7;
+        UAS_data.System.OperatorLongitude = system.operator_longitude * 1.0e-7;
+        UAS_data.System.AreaCount = system.area_count;
+        UAS_data.System.AreaRadius = system.area_radius;
+        UAS_data.System.AreaCeiling = system.area_ceiling;
+        UAS_data.System.AreaFloor = system.area_floor;
+        UAS_data.System.CategoryEU = (ODID_category_EU_t)system.category_eu;
+        UAS_data.System.ClassEU = (ODID_class_EU_t)system.class_eu;
+        UAS_data.System.OperatorAltitudeGeo = system.operator_altitude_geo;
+        UAS_data.System.Timestamp = system.timestamp;
+        UAS_data.SystemValid = 1;
+    }
+
+    // Location
+    if (changed & UAS_PART_LOCATION)
+    {
+        odid_initLocationData(&UAS_data.Location);
+        UAS_data.LocationValid = 0;
+    }
+    if ((changed & UAS_PART_LOCATION) && location.timestamp != 0)
+    {
+        UAS_data.Location.Status = (ODID_status_t)location.status;
+        UAS_data.Location.Direction = location.direction * 0.01;
+        UAS_data.Location.SpeedHorizontal = location.speed_horizontal * 0.01;
+        UAS_data.Location.SpeedVertical = location.speed_vertical * 0.01;
+        UAS_data.Location.Latitude = location.latitude * 1.0e-7;
+        UAS_data.Location.Longitude = location.longitude * 1.0e-7;
+        UAS_data.Location.AltitudeBaro = location.altitude_barometric;
+        UAS_data.Location.AltitudeGeo = location.altitude_geodetic;
+        UAS_data.Location.HeightType = (ODID_Height_reference_t)location.height_reference;
+        UAS_data.Location.Height = location.height;
+        UAS_data.Location.HorizAccuracy = (ODID_Horizontal_accuracy_t)location.horizontal_accuracy;
+        UAS_data.Location.VertAccuracy = (ODID_Vertical_accuracy_t)location.vertical_accuracy;
+        UAS_data.Location.BaroAccuracy = (ODID_Vertical_accuracy_t)location.barometer_accuracy;
+        UAS_data.Location.SpeedAccuracy = (ODID_Speed_accuracy_t)location.speed_accuracy;
+        UAS_data.Location.TSAccuracy = (ODID_Timestamp_accuracy_t)location.timestamp_accuracy;
+        UAS_data.Location.TimeStamp = location.timestamp;
+        UAS_data.LocationValid = 1;
+    }
+    // loop() marks a stale location on UAS_data for the web interface,
+    // put back the status and validity of the last location message
+    UAS_data.Location.Status = location.timestamp != 0 ? (ODID_status_t)location.status : ODID_STATUS_UNDECLARED;
+    UAS_data.LocationValid = location.timestamp != 0 ? 1 : 0;
+
+    return changed;
+}
@@ -0,0 +1,15 @@
+/*
+  fill in UAS_data from the transport messages and parameters
+ */
+#pragma once
+
+#include <opendroneid.h>
+#include "transport.h"
+
+/*
+  rebuild the parts of UAS_data whose messages (or parameters) changed
+  since the last call, returns the UAS_PART_* that were rebuilt.
+  flt_time_changed is set when the flight time message or the
+  parameters changed
+ */
+uint8_t uas_data_update(const Transport &t, ODID_UAS_Data &UAS_data, bool &flt_time_changed);
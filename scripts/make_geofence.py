@@ -0,0 +1,276 @@
+#!/usr/bin/env python3
+
+'''
+script to create the geofence partition image used by FlightChecks from
+the text airport, prison and country lists
+
+The image is a small directory followed by the databases, each one 4
+byte aligned:
+
+  header:  magic(u32) version(u16) entry_count(u16) image_size(u32)
+  entry:   name(16 bytes, nul padded) offset(u32) size(u32)
+
+The airport and prison databases are a header followed by fixed size
+records:
+
+  header:  magic(u32) version(u16) record_size(u16) record_count(u32)
+           band_start(u32) * (GEOFENCE_DB_BANDS+1)
+  record:  lat(i32, 1e-7 deg) lon(i32, 1e-7 deg) type(u8)
+
+Records are sorted by 1 degree latitude band and then by longitude, so
+the firmware can binary search the longitude range of each band it can
+reach instead of parsing every line of the text lists.
+
+The banned country polygons are cut into 1 degree tiles:
+
+  header:  magic(u32) version(u16) polygon_count(u16) tile_count(u32) edge_count(u32)
+  polygon: bbox lat_min lon_min lat_max lon_max (i32 * 4, 1e-7 deg)
+  tile:    key(u16) polygon(u16) inside(u8) bbox(i32 * 4) first_edge(u32) edge_count(u16)
+  edge:    lat1 lon1 lat2 lon2 (i32 * 4, 1e-7 deg)
+
+A tile record holds the edges of one polygon that cross the tile and
+whether the tile centre is inside that polygon. Tiles fully outside a
+polygon are left out. Records are sorted by key (lat_band * 360 + lon_band)
+so the firmware only reads the tiles it can reach.
+'''
+
+import argparse
+import bisect
+import math
+import os
+import struct
+import sys
+
+GEOFENCE_IMAGE_MAGIC = 0x4D494647  # "GFIM"
+GEOFENCE_IMAGE_VERSION = 1
+GEOFENCE_NAME_LEN = 16
+GEOFENCE_PARTITION_SIZE = 0x130000
+
+GEOFENCE_DB_MAGIC = 0x42444647  # "GFDB"
+GEOFENCE_DB_VERSION = 1
+GEOFENCE_DB_BANDS = 180
+RECORD_FORMAT = '<iiB'
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+
+COUNTRY_DB_MAGIC = 0x54434647  # "GFCT"
+COUNTRY_DB_VERSION = 1
+TILE_LON_BANDS = 360
+POLYGON_FORMAT = '<iiii'
+TILE_FORMAT = '<HHBiiiiIH'
+EDGE_FORMAT = '<iiii'
+
+
+def to_ie7(value):
+    '''convert a text coordinate to 1e-7 degrees'''
+    return int(round(float(value) * 1.0e7))
+
+
+def lat_band(lat):
+    '''latitude band of a coordinate in 1e-7 degrees'''
+    band = (lat + 900000000) // 10000000
+    return min(max(band, 0), GEOFENCE_DB_BANDS - 1)
+
+
+def parse_list(filename, with_type):
+    '''parse a "[type,]lat,lon" list, skipping malformed lines'''
+    records = []
+    for n, line in enumerate(open(filename, 'r'), start=1):
+        line = line.strip()
+        if not line or line.startswith('#'):
+            continue
+        fields = line.split(',')
+        try:
+            if with_type:
+                rtype, lat, lon = int(fields[0]), to_ie7(fields[1]), to_ie7(fields[2])
+            else:
+                rtype, lat, lon = 0, to_ie7(fields[0]), to_ie7(fields[1])
+        except (IndexError, ValueError):
+            print("%s:%u: skipping bad line '%s'" % (filename, n, line))
+            continue
+        if abs(lat) > 900000000 or abs(lon) > 1800000000 or rtype > 255:
+            print("%s:%u: skipping out of range line '%s'" % (filename, n, line))
+            continue
+        records.append((lat, lon, rtype))
+    return records
+
+
+def make_db(name, records):
+    '''a sorted database with its band index'''
+    records.sort(key=lambda r: (lat_band(r[0]), r[1]))
+
+    band_start = [0] * (GEOFENCE_DB_BANDS + 1)
+    for (lat, lon, rtype) in records:
+        band_start[lat_band(lat) + 1] += 1
+    for i in range(GEOFENCE_DB_BANDS):
+        band_start[i + 1] += band_start[i]
+
+    out = bytearray()
+    out += struct.pack('<IHHI', GEOFENCE_DB_MAGIC, GEOFENCE_DB_VERSION, RECORD_SIZE, len(records))
+    out += struct.pack('<%uI' % len(band_start), *band_start)
+    for (lat, lon, rtype) in records:
+        out += struct.pack(RECORD_FORMAT, lat, lon, rtype)
+    print("%s: %u records" % (name, len(records)))
+    return bytes(out)
+
+
+def parse_polygons(filename):
+    '''parse a polygon list, each polygon starts with a "#" line'''
+    polygons = []
+    for n, line in enumerate(open(filename, 'r'), start=1):
+        line = line.strip()
+        if not line:
+            continue
+        if line.startswith('#'):
+            polygons.append([])
+            continue
+        if not polygons:
+            print("%s:%u: coordinate outside of a polygon" % (filename, n))
+            continue
+        fields = line.split(',')
+        try:
+            polygons[-1].append((to_ie7(fields[0]), to_ie7(fields[1])))
+        except (IndexError, ValueError):
+            print("%s:%u: skipping bad line '%s'" % (filename, n, line))
+    return [p for p in polygons if len(p) >= 3]
+
+
+def polygon_edges(polygon):
+    '''edges of a polygon, closing it if the list does not'''
+    edges = list(zip(polygon[:-1], polygon[1:]))
+    if polygon[0] != polygon[-1]:
+        edges.append((polygon[-1], polygon[0]))
+    return edges
+
+
+def lon_band(lon):
+    '''longitude band of a coordinate in 1e-7 degrees'''
+    band = (lon + 1800000000) // 10000000
+    return min(max(band, 0), TILE_LON_BANDS - 1)
+
+
+def edge_tiles(a, b):
+    '''tiles crossed by an edge, clipping it to each latitude band'''
+    tiles = set()
+    (lat1, lon1), (lat2, lon2) = a, b
+    for band in range(lat_band(min(lat1, lat2)), lat_band(max(lat1, lat2)) + 1):
+        lo = band * 10000000 - 900000000
+        hi = lo + 10000000
+        if lat1 == lat2:
+            lons = [lon1, lon2]
+        else:
+            # longitudes where the edge enters and leaves the band
+            lons = []
+            for lat in (max(min(lat1, lat2), lo), min(max(lat1, lat2), hi)):
+                lons.append(lon1 + (lon2 - lon1) * (lat - lat1) / float(lat2 - lat1))
+        for lband in range(lon_band(int(math.floor(min(lons)))), lon_band(int(math.ceil(max(lons)))) + 1):
+            tiles.add(band * TILE_LON_BANDS + lband)
+    return tiles
+
+
+def inside_bands(edges, band, lband_first, lband_last):
+    '''which tile centres of a latitude band are inside the polygon (even-odd rule)'''
+    lat = band * 10000000 - 900000000 + 5000000
+    crossings = []
+    for (lat1, lon1), (lat2, lon2) in edges:
+        if (lat1 > lat) != (lat2 > lat):
+            crossings.append(lon1 + (lon2 - lon1) * (lat - lat1) / float(lat2 - lat1))
+    crossings.sort()
+    inside = set()
+    for lband in range(lband_first, lband_last + 1):
+        lon = lband * 10000000 - 1800000000 + 5000000
+        if (len(crossings) - bisect.bisect_right(crossings, lon)) % 2 == 1:
+            inside.add(lband)
+    return inside
+
+
+def make_country_db(name, polygons):
+    '''the tiled country database'''
+    polygon_table = []
+    tiles = []
+    edge_table = []
+    for index, polygon in enumerate(polygons, start=1):
+        lats = [c[0] for c in polygon]
+        lons = [c[1] for c in polygon]
+        polygon_table.append((min(lats), min(lons), max(lats), max(lons)))
+        edges = polygon_edges(polygon)
+
+        tile_edges = {}
+        for edge in edges:
+            for key in edge_tiles(*edge):
+                tile_edges.setdefault(key, []).append(edge)
+
+        inside = set()
+        lband_first, lband_last = lon_band(min(lons)), lon_band(max(lons))
+        for band in range(lat_band(min(lats)), lat_band(max(lats)) + 1):
+            for lband in inside_bands(edges, band, lband_first, lband_last):
+                inside.add(band * TILE_LON_BANDS + lband)
+
+        for key in sorted(set(tile_edges.keys()) | inside):
+            tiles.append((key, index, key in inside, tile_edges.get(key, [])))
+
+    tiles.sort(key=lambda t: (t[0], t[1]))
+    out = bytearray()
+    edge_count = sum(len(t[3]) for t in tiles)
+    out += struct.pack('<IHHII', COUNTRY_DB_MAGIC, COUNTRY_DB_VERSION, len(polygon_table), len(tiles), edge_count)
+    for bbox in polygon_table:
+        out += struct.pack(POLYGON_FORMAT, *bbox)
+    first_edge = 0
+    for (key, index, is_inside, edges) in tiles:
+        if edges:
+            points = [c for e in edges for c in e]
+            bbox = (min(c[0] for c in points), min(c[1] for c in points),
+                    max(c[0] for c in points), max(c[1] for c in points))
+        else:
+            # empty box, nothing to cross
+            bbox = (1, 1, 0, 0)
+        out += struct.pack(TILE_FORMAT, key, index, 1 if is_inside else 0, bbox[0], bbox[1], bbox[2], bbox[3], first_edge, len(edges))
+        first_edge += len(edges)
+    for (key, index, is_inside, edges) in tiles:
+        for (a, b) in edges:
+            out += struct.pack(EDGE_FORMAT, a[0], a[1], b[0], b[1])
+    print("%s: %u polygons, %u tiles and %u edges" % (name, len(polygon_table), len(tiles), edge_count))
+    return bytes(out)
+
+
+def write_image(filename, databases):
+    '''write the partition image holding the named databases'''
+    header_size = struct.calcsize('<IHHI') + len(databases) * struct.calcsize('<%usII' % GEOFENCE_NAME_LEN)
+    offset = (header_size + 3) & ~3
+    entries = bytearray()
+    body = bytearray()
+    for (name, data) in databases:
+        entries += struct.pack('<%usII' % GEOFENCE_NAME_LEN, name.encode('ascii'), offset + len(body), len(data))
+        body += data
+        body += bytes(-len(body) % 4)
+    image_size = offset + len(body)
+    if image_size > GEOFENCE_PARTITION_SIZE:
+        print("Image is %u bytes, the partition only holds %u" % (image_size, GEOFENCE_PARTITION_SIZE))
+        sys.exit(1)
+    out = open(filename, 'wb')
+    out.write(struct.pack('<IHHI', GEOFENCE_IMAGE_MAGIC, GEOFENCE_IMAGE_VERSION, len(databases), image_size))
+    out.write(entries)
+    out.write(bytes(offset - header_size))
+    out.write(body)
+    out.close()
+    print("Wrote %s, %u bytes" % (filename, image_size))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Geofence image generator')
+    parser.add_argument('input_dir', help='directory holding the text airport, prison and country lists')
+    parser.add_argument('output', help='partition image to write')
+    args = parser.parse_args()
+
+    sources = {}
+    for src in ['world_airport_list.txt', 'world_prison_list.txt', 'banned_countries.txt']:
+        sources[src] = os.path.join(args.input_dir, src)
+        if not os.path.exists(sources[src]):
+            print("Missing %s" % sources[src])
+            sys.exit(1)
+
+    databases = [
+        ('airports.bin', make_db('airports.bin', parse_list(sources['world_airport_list.txt'], True))),
+        ('prisons.bin', make_db('prisons.bin', parse_list(sources['world_prison_list.txt'], False))),
+        ('countries.bin', make_country_db('countries.bin', parse_polygons(sources['banned_countries.txt']))),
+    ]
+    write_image(args.output, databases)